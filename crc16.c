@@ -0,0 +1,14 @@
+// crc16.c
+#include "crc16.h"
+
+// crc16_nibble_table[i] = CRC de (i << 12) tras 4 desplazamientos con 0x1021
+static const uint16_t crc16_nibble_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+uint16_t CRC16_Update(uint16_t crc, uint8_t data) {
+    crc = (uint16_t)(crc << 4) ^ crc16_nibble_table[(uint8_t)(crc >> 12) ^ (data >> 4)];
+    crc = (uint16_t)(crc << 4) ^ crc16_nibble_table[(uint8_t)(crc >> 12) ^ (data & 0x0F)];
+    return crc;
+}
@@ -0,0 +1,20 @@
+// crc16.h
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+// CRC-16/CCITT (polinomio 0x1021, valor inicial 0xFFFF).
+// Implementacin con tabla de 16 entradas (un nibble por paso): 32 bytes de
+// ROM y dos consultas por byte, apta para ir acumulando byte a byte.
+#define CRC16_INIT 0xFFFF
+
+/**
+ * @brief Acumula un byte en el CRC.
+ * @param crc CRC parcial (CRC16_INIT al empezar).
+ * @param data Byte a aadir.
+ * @return CRC actualizado.
+ */
+uint16_t CRC16_Update(uint16_t crc, uint8_t data);
+
+#endif // CRC16_H
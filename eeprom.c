@@ -1,7 +1,10 @@
 //eeprom.c
 
 #include <stdbool.h>
+#include <string.h>
 #include "eeprom.h"
+#include "crc16.h"
+#include "flash_store.h"
 
 // Definiciones de direcciones bsicas:
 #define EEPROM_SECUENCIAS_ADDR  0x200   // Usado en funciones antiguas, ahora se utiliza EEPROM_BASE_SEQUENCES
@@ -12,33 +15,231 @@
 #define FACTORY_DEFAULT_PORTE 0x49 // R4, R5, R6
 #define FACTORY_DEFAULT_PORTF 0x24 // R7, R8
 
-// Funciones bsicas de lectura/escritura:
-void EEPROM_Init(void){
-    EECON1 = 0; // Inicializa el mdulo EEPROM
-}
+// --- COLA DE ESCRITURA ASNCRONA ---
+// Cada byte tarda ~4 ms en grabarse. En lugar de esperar con las interrupciones
+// apagadas, las escrituras se encolan y la ISR de fin de escritura (EEIF)
+// arranca la siguiente. El bucle principal, el Timer1 y la UART siguen corriendo.
+#define EEPROM_WRITE_QUEUE_SIZE 32
+
+typedef struct {
+    uint16_t addr;
+    uint8_t data;
+} EEPROM_WriteOp;
+
+static volatile EEPROM_WriteOp eeprom_write_queue[EEPROM_WRITE_QUEUE_SIZE];
+static volatile uint8_t wq_head = 0;              // Prxima posicin libre
+static volatile uint8_t wq_tail = 0;              // Escritura en curso / prxima a grabar
+static volatile bool eeprom_write_in_progress = false;
+static uint16_t wq_enqueued = 0;                  // Escrituras encoladas (marca de la ltima)
+static volatile uint16_t wq_completed = 0;        // Escrituras terminadas (lo avanza la ISR)
+
+// --- ESPEJO EN RAM DE LA EEPROM ---
+// Se carga completa al arrancar y se actualiza al encolar cada escritura
+// (write-through), as que todas las lecturas salen de RAM y ya reflejan las
+// escrituras pendientes en la cola.
+static uint8_t eeprom_mirror[EEPROM_SIZE];
+
+// --- CRC DE LA IMAGEN DE CONFIGURACIN ---
+// Cubre toda la EEPROM salvo los 2 bytes donde se guarda. Se recalcula por
+// partes en EEPROM_Task() cuando la cola queda vaca tras una modificacin.
+#define EEPROM_CRC_BYTES_PER_TASK 64
+static bool eeprom_image_valid = true;
+static bool crc_dirty = false;
+static bool crc_running = false;
+static uint16_t crc_cursor;
+static uint16_t crc_accum;
+
+// --- TRANSACCIN DE CONFIGURACIN ---
+static bool txn_open = false;
+static uint16_t txn_elapsed_s;
+static bool txn_prev_valid;             // Validez de la imagen al abrirla
+static bool txn_rollback = false;       // Restaurando la copia de respaldo
+static bool txn_rolled_back = false;    // Restauracin terminada, sin recoger
+static uint8_t txn_block;               // Prximo bloque de flash a restaurar
+static uint16_t txn_cursor;             // Prximo byte de EEPROM a restaurar
+#define TXN_RECORD_BLOCKS (FLASH_TXN_RECORDS_SIZE / FLASH_ERASE_BLOCK_SIZE)
+static uint8_t txn_saved_blocks[(TXN_RECORD_BLOCKS + 7) / 8]; // Bloques con copia
+
+static bool EEPROM_ValidateConfigSet(void);
+static void EEPROM_RollbackTask(void);
 
-void EEPROM_Write(uint16_t addr, uint8_t data){
+/**
+ * @brief Arranca la grabacin de la entrada wq_tail. Debe llamarse con las
+ * interrupciones deshabilitadas (desde la ISR o con GIE = 0).
+ */
+static void EEPROM_StartNextWrite(void) {
+    if (eeprom_write_in_progress || wq_head == wq_tail) {
+        return;
+    }
+    uint16_t addr = eeprom_write_queue[wq_tail].addr;
     EEADR = (addr & 0xFF);
     EEADRH = ((addr >> 8) & 0x03);
-    EEDATA = data;
+    EEDATA = eeprom_write_queue[wq_tail].data;
     EECON1bits.EEPGD = 0;
     EECON1bits.CFGS = 0;
     EECON1bits.WREN = 1;
-    INTCONbits.GIE = 0;
 
     EECON2 = 0x55;
     EECON2 = 0xAA;
     EECON1bits.WR = 1;
+    eeprom_write_in_progress = true;
+}
 
-    while(EECON1bits.WR) {
-        CLRWDT();
+// Arranca la cola desde el bucle principal si est detenida.
+static void EEPROM_Kick(void) {
+    bool gie = INTCONbits.GIE;
+    INTCONbits.GIE = 0;
+    EEPROM_StartNextWrite();
+    INTCONbits.GIE = gie;
+}
+
+// --- Contadores de escrituras por tabla ---
+static uint16_t eeprom_writes_performed[EEPROM_NUM_TABLES];
+static uint16_t eeprom_writes_skipped[EEPROM_NUM_TABLES];
+
+// --- Descriptores de las tablas del mapa (en ROM) ---
+typedef struct {
+    uint16_t base;
+    uint8_t record_size;
+    uint8_t count;
+} EEPROM_TableInfo;
+
+static const EEPROM_TableInfo eeprom_tables[EEPROM_NUM_TABLES] = {
+    { 0x000,                     1,                      0 },   // SYSTEM (no se invalida)
+    { EEPROM_BASE_MOVEMENTS,     MOVEMENT_SIZE,          MAX_MOVEMENTS },
+    { EEPROM_BASE_SEQUENCES,     SEQUENCE_SIZE,          MAX_SEQUENCES },
+    { EEPROM_BASE_PLANS,         PLAN_SIZE,              MAX_PLANS },
+    { EEPROM_BASE_INTERMITENCES, INTERMITTENCE_SIZE,     MAX_INTERMITENCES },
+    { EEPROM_BASE_HOLIDAYS,      HOLIDAY_SIZE,           MAX_HOLIDAYS },
+    { EEPROM_BASE_FLOW_CONTROL,  FLOW_CONTROL_RULE_SIZE, MAX_FLOW_CONTROL_RULES },
+};
+
+static uint8_t EEPROM_TableForAddress(uint16_t addr) {
+    for (uint8_t t = 1; t < EEPROM_NUM_TABLES; t++) {
+        const EEPROM_TableInfo *info = &eeprom_tables[t];
+        if (addr >= info->base && addr < info->base + (uint16_t)info->record_size * info->count) {
+            return t;
+        }
     }
+    return EEPROM_TABLE_SYSTEM;
+}
 
-    EECON1bits.WREN = 0;
-    INTCONbits.GIE = 1;
+// --- BORRADO LGICO (tablas con bit de validez) ---
+// Un bit a 0 en EEPROM_TABLE_VALID_ADDR marca la tabla como borrada: los
+// lectores la ven vaca (0xFF) y EEPROM_Task() la limpia fsicamente en segundo
+// plano. Hasta que la tabla vuelve a ser vlida no se aceptan escrituras en
+// ella: un registro grabado antes de la limpieza no se distinguira tras un
+// reinicio de los restos borrados y el barrido reanudado lo pisara. Las
+// escrituras encoladas despus del bit de validez llegan a la EEPROM despus
+// de l, as que un reinicio nunca deja un registro nuevo en una tabla borrada.
+// Los valores de fbrica de EEPROM_InitStructure() esperan al final del barrido.
+#define EEPROM_ERASABLE_TABLES ((uint8_t)(((1 << EEPROM_NUM_TABLES) - 1) & ~(1 << EEPROM_TABLE_SYSTEM)))
+static uint8_t eeprom_valid_bitmap = EEPROM_ALL_TABLES_VALID;
+static uint8_t scrub_table = EEPROM_NUM_TABLES;
+static uint16_t scrub_offset = 0;
+static bool init_pending = false;
+
+static void EEPROM_ScrubTask(void);
+static void EEPROM_WriteFactoryDefaults(void);
+
+static bool EEPROM_IsTableValid(uint8_t table) {
+    return (eeprom_valid_bitmap & (1 << table)) != 0;
 }
 
-uint8_t EEPROM_Read(uint16_t addr){
+// Antes de Timers_Init() las interrupciones estn apagadas: se atiende EEIF por sondeo.
+static void EEPROM_PollIfInterruptsOff(void) {
+    if (!INTCONbits.GIE && PIR2bits.EEIF) {
+        EEPROM_WriteComplete_ISR();
+    }
+}
+
+static uint8_t EEPROM_ReadPhysical(uint16_t addr);
+
+// --- REGISTRO DE ESTADO EN TIEMPO DE EJECUCIN (log con nivelacin de desgaste) ---
+// Ranuras de 8 bytes repartidas en los huecos libres del mapa. Cada anotacin va
+// a la ranura siguiente a la ms reciente, as cada celda se graba 1/N veces.
+// Formato: [seq][plan][paso][ciclos H][ciclos L][fallos H][fallos L][check]
+static const uint16_t runtime_log_slots[EEPROM_RUNTIME_LOG_SLOTS] = {
+    0x008, 0x010, 0x018, 0x278, 0x3F8
+};
+static uint8_t runtime_log_newest = EEPROM_RUNTIME_LOG_SLOTS - 1;
+static uint8_t runtime_log_seq = 0xFF;
+
+static bool EEPROM_IsRuntimeLogAddress(uint16_t addr) {
+    for (uint8_t i = 0; i < EEPROM_RUNTIME_LOG_SLOTS; i++) {
+        if (addr >= runtime_log_slots[i] && addr < runtime_log_slots[i] + EEPROM_RUNTIME_LOG_RECORD_SIZE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// El log cambia a menudo: no forma parte de la imagen de configuracin sellada.
+static bool EEPROM_IsExcludedFromCRC(uint16_t addr) {
+    return (addr == EEPROM_CRC_ADDR || addr == EEPROM_CRC_ADDR + 1 || EEPROM_IsRuntimeLogAddress(addr));
+}
+
+static uint8_t EEPROM_RuntimeLogCheck(const uint8_t *record) {
+    uint16_t crc = CRC16_INIT;
+    for (uint8_t i = 0; i < EEPROM_RUNTIME_LOG_RECORD_SIZE - 1; i++) {
+        crc = CRC16_Update(crc, record[i]);
+    }
+    return (uint8_t)(crc & 0xFF);
+}
+
+/**
+ * @brief Busca la anotacin ms reciente con check correcto (al arrancar).
+ * @details Una anotacin a medio grabar (corte de energa) no pasa el check y
+ * se queda la anterior.
+ */
+static void EEPROM_RuntimeLogScan(void) {
+    bool found = false;
+    for (uint8_t i = 0; i < EEPROM_RUNTIME_LOG_SLOTS; i++) {
+        const uint8_t *record = &eeprom_mirror[runtime_log_slots[i]];
+        if (record[EEPROM_RUNTIME_LOG_RECORD_SIZE - 1] != EEPROM_RuntimeLogCheck(record)) continue;
+        if (!found || (int8_t)(record[0] - runtime_log_seq) > 0) {
+            found = true;
+            runtime_log_newest = i;
+            runtime_log_seq = record[0];
+        }
+    }
+}
+
+bool EEPROM_LogLoad(RuntimeState *state) {
+    const uint8_t *record = &eeprom_mirror[runtime_log_slots[runtime_log_newest]];
+    if (record[0] != runtime_log_seq || record[EEPROM_RUNTIME_LOG_RECORD_SIZE - 1] != EEPROM_RuntimeLogCheck(record)) {
+        return false; // Log vaco
+    }
+    state->plan_id = (int8_t)record[1];
+    state->step = record[2];
+    state->cycles = ((uint16_t)record[3] << 8) | record[4];
+    state->faults = ((uint16_t)record[5] << 8) | record[6];
+    return true;
+}
+
+void EEPROM_LogAppend(const RuntimeState *state) {
+    uint8_t record[EEPROM_RUNTIME_LOG_RECORD_SIZE];
+    uint8_t slot = (uint8_t)((runtime_log_newest + 1) % EEPROM_RUNTIME_LOG_SLOTS);
+
+    record[0] = (uint8_t)(runtime_log_seq + 1);
+    record[1] = (uint8_t)state->plan_id;
+    record[2] = state->step;
+    record[3] = (uint8_t)(state->cycles >> 8);
+    record[4] = (uint8_t)(state->cycles & 0xFF);
+    record[5] = (uint8_t)(state->faults >> 8);
+    record[6] = (uint8_t)(state->faults & 0xFF);
+    record[7] = EEPROM_RuntimeLogCheck(record);
+
+    // El check va al final: si se corta la energa antes, la ranura no es vlida.
+    for (uint8_t i = 0; i < EEPROM_RUNTIME_LOG_RECORD_SIZE; i++) {
+        EEPROM_Write(runtime_log_slots[slot] + i, record[i]);
+    }
+    runtime_log_newest = slot;
+    runtime_log_seq = record[0];
+}
+
+// Lectura directa del hardware: solo para la carga inicial del espejo.
+static uint8_t EEPROM_ReadHW(uint16_t addr) {
     EEADR = (addr & 0xFF);
     EEADRH = ((addr >> 8) & 0x03);
     EECON1bits.EEPGD = 0;
@@ -48,7 +249,428 @@ uint8_t EEPROM_Read(uint16_t addr){
     return EEDATA;
 }
 
+static uint16_t EEPROM_ComputeImageCRC(void) {
+    uint16_t crc = CRC16_INIT;
+    for (uint16_t addr = 0; addr < EEPROM_SIZE; addr++) {
+        if (!EEPROM_IsExcludedFromCRC(addr)) {
+            crc = CRC16_Update(crc, eeprom_mirror[addr]);
+        }
+    }
+    return crc;
+}
+
+uint16_t EEPROM_GetStoredCRC(void) {
+    return ((uint16_t)eeprom_mirror[EEPROM_CRC_ADDR] << 8) | eeprom_mirror[EEPROM_CRC_ADDR + 1];
+}
+
+// Funciones bsicas de lectura/escritura:
+void EEPROM_Init(void){
+    EECON1 = 0; // Inicializa el mdulo EEPROM
+    PIR2bits.EEIF = 0;
+    IPR2bits.EEIP = 1; // Alta prioridad (nica ISR en timers.c)
+    PIE2bits.EEIE = 1;
+
+    // Carga completa del espejo y verificacin de integridad.
+    for (uint16_t addr = 0; addr < EEPROM_SIZE; addr++) {
+        eeprom_mirror[addr] = EEPROM_ReadHW(addr);
+    }
+    uint16_t stored_crc = EEPROM_GetStoredCRC();
+    if (stored_crc == 0xFFFF) {
+        // Imagen an sin sellar (EEPROM de una versin anterior): se sella en segundo plano.
+        eeprom_image_valid = true;
+        crc_dirty = true;
+    } else {
+        eeprom_image_valid = (EEPROM_ComputeImageCRC() == stored_crc);
+    }
+
+    EEPROM_RuntimeLogScan();
+
+    // Retomar la limpieza de un borrado lgico interrumpido por un reinicio.
+    eeprom_valid_bitmap = EEPROM_ReadPhysical(EEPROM_TABLE_VALID_ADDR) | (uint8_t)~EEPROM_ERASABLE_TABLES;
+    scrub_table = 1;
+    scrub_offset = 0;
+}
+
+void EEPROM_WriteComplete_ISR(void) {
+    PIR2bits.EEIF = 0;
+    if (eeprom_write_in_progress) {
+        eeprom_write_in_progress = false;
+        wq_tail = (wq_tail + 1) % EEPROM_WRITE_QUEUE_SIZE;
+        wq_completed++;
+    }
+    EEPROM_StartNextWrite();
+    if (!eeprom_write_in_progress) {
+        EECON1bits.WREN = 0;
+    }
+}
+
+/**
+ * @brief Encola un byte comparando antes con el contenido fsico (sin tener en
+ * cuenta el borrado lgico). Usada por la API pblica y por el barrido.
+ */
+static bool EEPROM_Enqueue(uint16_t addr, uint8_t data) {
+    uint8_t table = EEPROM_TableForAddress(addr);
+
+    // Comparar antes de escribir: la GUI suele reenviar registros completos.
+    // Un byte idntico no consume tiempo de grabacin ni ciclos de vida.
+    if (EEPROM_ReadPhysical(addr) == data) {
+        eeprom_writes_skipped[table]++;
+        return true;
+    }
+
+    uint8_t next_head = (wq_head + 1) % EEPROM_WRITE_QUEUE_SIZE;
+    if (next_head == wq_tail) {
+        return false; // Cola llena
+    }
+    eeprom_writes_performed[table]++;
+    eeprom_mirror[addr & (EEPROM_SIZE - 1)] = data;
+    if (!EEPROM_IsExcludedFromCRC(addr)) {
+        crc_dirty = true;
+        crc_running = false; // Reiniciar un clculo en curso
+    }
+    eeprom_write_queue[wq_head].addr = addr;
+    eeprom_write_queue[wq_head].data = data;
+    wq_head = next_head;
+    wq_enqueued++;
+    EEPROM_Kick();
+    return true;
+}
+
+bool EEPROM_WriteAsync(uint16_t addr, uint8_t data) {
+    if (!EEPROM_IsTableValid(EEPROM_TableForAddress(addr))) {
+        return false; // Tabla pendiente de limpieza tras un borrado de fbrica
+    }
+    return EEPROM_Enqueue(addr, data);
+}
+
+bool EEPROM_IsErasePending(void) {
+    return eeprom_valid_bitmap != EEPROM_ALL_TABLES_VALID;
+}
+
+void EEPROM_Write(uint16_t addr, uint8_t data){
+    // Solo bloquea si la cola est llena o si la tabla espera su limpieza, que
+    // entonces se adelanta aqu; las interrupciones siguen activas.
+    while (!EEPROM_WriteAsync(addr, data)) {
+        CLRWDT();
+        EEPROM_PollIfInterruptsOff();
+        EEPROM_ScrubTask();
+    }
+}
+
+void EEPROM_Flush(void) {
+    while (wq_head != wq_tail) {
+        CLRWDT();
+        EEPROM_PollIfInterruptsOff();
+    }
+}
+
+uint8_t EEPROM_GetQueueDepth(void) {
+    return (uint8_t)((wq_head - wq_tail + EEPROM_WRITE_QUEUE_SIZE) % EEPROM_WRITE_QUEUE_SIZE);
+}
+
+uint16_t EEPROM_GetWriteTicket(void) {
+    return wq_enqueued;
+}
+
+bool EEPROM_IsWriteDone(uint16_t ticket) {
+    uint8_t gie = INTCONbits.GIE;
+    INTCONbits.GIE = 0;
+    uint16_t completed = wq_completed;
+    INTCONbits.GIE = gie;
+    return (int16_t)(completed - ticket) >= 0;
+}
+
+// Hay una escritura en cola (o en curso) para la direccin. Llamar con GIE = 0.
+static bool EEPROM_IsPending(uint16_t addr) {
+    for (uint8_t i = wq_tail; i != wq_head; i = (uint8_t)((i + 1) % EEPROM_WRITE_QUEUE_SIZE)) {
+        if (eeprom_write_queue[i].addr == addr) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Compara un rango de la EEPROM fsica con el espejo.
+ * @details EEADR/EEDATA los usa tambin la grabacin en curso, as que si hay
+ * una se devuelve EEPROM_VERIFY_BUSY en lugar de esperarla. Las
+ * interrupciones se apagan solo durante cada lectura, para que la ISR no
+ * arranque una grabacin entre la comprobacin y la lectura.
+ */
+static uint8_t EEPROM_VerifyRange(uint16_t addr, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        uint8_t gie = INTCONbits.GIE;
+        INTCONbits.GIE = 0;
+        if (eeprom_write_in_progress || EECON1bits.WR) {
+            INTCONbits.GIE = gie;
+            return EEPROM_VERIFY_BUSY;
+        }
+        bool pending = EEPROM_IsPending(addr + i);
+        uint8_t physical = pending ? 0 : EEPROM_ReadHW(addr + i);
+        INTCONbits.GIE = gie;
+        if (!pending && physical != eeprom_mirror[(addr + i) & (EEPROM_SIZE - 1)]) {
+            return EEPROM_VERIFY_MISMATCH;
+        }
+    }
+    return EEPROM_VERIFY_OK;
+}
+
+uint8_t EEPROM_VerifyRecord(uint8_t table, uint8_t index) {
+    if (table == EEPROM_TABLE_SYSTEM) {
+        return EEPROM_VerifyRange(0x000, EEPROM_CRC_ADDR);
+    }
+    if (table >= EEPROM_NUM_TABLES) return EEPROM_VERIFY_MISMATCH;
+    const EEPROM_TableInfo *info = &eeprom_tables[table];
+    if (index >= info->count) return EEPROM_VERIFY_OK; // En flash: FlashStore_Write ya lo reley
+    return EEPROM_VerifyRange(info->base + (uint16_t)index * info->record_size, info->record_size);
+}
+
+void EEPROM_GetWriteStats(uint8_t table, uint16_t *performed, uint16_t *skipped) {
+    if (table >= EEPROM_NUM_TABLES) {
+        *performed = 0;
+        *skipped = 0;
+        return;
+    }
+    *performed = eeprom_writes_performed[table];
+    *skipped = eeprom_writes_skipped[table];
+}
+
+void EEPROM_ResetWriteStats(void) {
+    for (uint8_t i = 0; i < EEPROM_NUM_TABLES; i++) {
+        eeprom_writes_performed[i] = 0;
+        eeprom_writes_skipped[i] = 0;
+    }
+}
+
+uint8_t EEPROM_Read(uint16_t addr){
+    // Las tablas borradas lgicamente se leen vacas.
+    if (eeprom_valid_bitmap != EEPROM_ALL_TABLES_VALID) {
+        if (!EEPROM_IsTableValid(EEPROM_TableForAddress(addr))) {
+            return 0xFF;
+        }
+    }
+    return EEPROM_ReadPhysical(addr);
+}
+
+void EEPROM_ReadBlock(uint16_t addr, uint8_t *dest, uint8_t len){
+    bool erased = false;
+    if (eeprom_valid_bitmap != EEPROM_ALL_TABLES_VALID) {
+        erased = !EEPROM_IsTableValid(EEPROM_TableForAddress(addr));
+    }
+    const uint8_t *src = &eeprom_mirror[addr & (EEPROM_SIZE - 1)];
+    while (len-- > 0) {
+        *dest++ = erased ? 0xFF : *src++;
+    }
+}
+
+static uint8_t EEPROM_ReadPhysical(uint16_t addr){
+    return eeprom_mirror[addr & (EEPROM_SIZE - 1)];
+}
+
+bool EEPROM_IsImageValid(void) {
+    return eeprom_image_valid;
+}
+
+void EEPROM_ResealImage(void) {
+    eeprom_image_valid = true;
+    crc_dirty = true;
+    crc_running = false;
+}
+
+bool EEPROM_BeginTransaction(void) {
+    if (txn_open || EEPROM_IsErasePending()) return false;
+    // Un borrado pendiente del almacn se hace ahora: hecho a mitad de la
+    // transaccin se llevara tambin la copia de respaldo.
+    if (EEPROM_Read(EEPROM_FLASH_STORE_STATE_ADDR) == FLASH_STORE_PENDING_ERASE) {
+        FlashStore_EraseAll();
+        EEPROM_Write(EEPROM_FLASH_STORE_STATE_ADDR, 0xFF);
+    }
+    for (uint16_t addr = 0; addr < EEPROM_SIZE; addr += FLASH_ERASE_BLOCK_SIZE) {
+        if (!FlashStore_Write(FLASH_BASE_TXN_EEPROM + addr, &eeprom_mirror[addr], FLASH_ERASE_BLOCK_SIZE)) {
+            return false;
+        }
+    }
+    memset(txn_saved_blocks, 0, sizeof(txn_saved_blocks));
+    txn_prev_valid = eeprom_image_valid;
+    txn_open = true;
+    txn_elapsed_s = 0;
+    crc_running = false;
+    return true;
+}
+
+bool EEPROM_IsTransactionOpen(void) {
+    return txn_open;
+}
+
+bool EEPROM_IsRollbackActive(void) {
+    return txn_rollback;
+}
+
+bool EEPROM_TakeRollbackDone(void) {
+    bool done = txn_rolled_back;
+    txn_rolled_back = false;
+    return done;
+}
+
+bool EEPROM_CommitTransaction(void) {
+    if (txn_rollback || !EEPROM_ValidateConfigSet()) {
+        return false;
+    }
+    txn_open = false;
+    EEPROM_ResealImage();
+    return true;
+}
+
+void EEPROM_AbortTransaction(void) {
+    if (!txn_open || txn_rollback) return;
+    txn_rollback = true;
+    txn_block = 0;
+    txn_cursor = 0;
+}
+
+/**
+ * @brief Copia a la zona de respaldo los bloques de registros extendidos que
+ * la transaccin abierta va a modificar por primera vez.
+ */
+static bool EEPROM_TxnSaveBlocks(uint16_t offset, uint8_t len) {
+    uint8_t first = (uint8_t)(offset / FLASH_ERASE_BLOCK_SIZE);
+    uint8_t last = (uint8_t)((offset + len - 1) / FLASH_ERASE_BLOCK_SIZE);
+    for (uint8_t b = first; b <= last; b++) {
+        if (b >= TXN_RECORD_BLOCKS) return false;
+        if (txn_saved_blocks[b >> 3] & (1 << (b & 7))) continue;
+        uint16_t block_offset = (uint16_t)b * FLASH_ERASE_BLOCK_SIZE;
+        if (!FlashStore_CopyBlock(FLASH_BASE_TXN_RECORDS + block_offset, block_offset)) return false;
+        txn_saved_blocks[b >> 3] |= (uint8_t)(1 << (b & 7));
+    }
+    return true;
+}
+
+/**
+ * @brief Restaura la copia de respaldo tras un aborto, por partes.
+ * @details Primero los bloques de flash (uno por llamada: la CPU se detiene
+ * mientras se graban) y despus los bytes de EEPROM que difieren de la copia,
+ * al ritmo de la cola. El log y el CRC no se tocan.
+ */
+static void EEPROM_RollbackTask(void) {
+    if (!txn_rollback) return;
+
+    while (txn_block < TXN_RECORD_BLOCKS) {
+        uint8_t b = txn_block++;
+        if (txn_saved_blocks[b >> 3] & (1 << (b & 7))) {
+            uint16_t block_offset = (uint16_t)b * FLASH_ERASE_BLOCK_SIZE;
+            FlashStore_CopyBlock(block_offset, FLASH_BASE_TXN_RECORDS + block_offset);
+            return;
+        }
+    }
+
+    for (uint8_t n = 0; n < EEPROM_ROLLBACK_BYTES_PER_TASK && txn_cursor < EEPROM_SIZE; n++) {
+        if (!EEPROM_IsExcludedFromCRC(txn_cursor)) {
+            uint8_t saved = FlashStore_Read(FLASH_BASE_TXN_EEPROM + txn_cursor);
+            if (eeprom_mirror[txn_cursor] != saved && !EEPROM_Enqueue(txn_cursor, saved)) return; // Cola llena: se sigue en la prxima llamada
+        }
+        txn_cursor++;
+    }
+    if (txn_cursor < EEPROM_SIZE) return;
+
+    // La cabecera de validez restaurada manda otra vez sobre el borrado lgico.
+    eeprom_valid_bitmap = EEPROM_ReadPhysical(EEPROM_TABLE_VALID_ADDR) | (uint8_t)~EEPROM_ERASABLE_TABLES;
+    scrub_table = 1;
+    scrub_offset = 0;
+    txn_rollback = false;
+    txn_open = false;
+    txn_rolled_back = true;
+    if (txn_prev_valid) {
+        EEPROM_ResealImage();
+    } else {
+        eeprom_image_valid = false;
+    }
+}
+
+void EEPROM_TransactionTick(void) {
+    if (txn_open && ++txn_elapsed_s >= CONFIG_TXN_TIMEOUT_S) {
+        EEPROM_AbortTransaction();
+    }
+}
+
+/**
+ * @brief Comprueba que la configuracin preparada no tenga referencias rotas.
+ * @details Cada secuencia no vaca debe tener solo movimientos vlidos,
+ * cada plan activo debe apuntar a una secuencia existente y cada regla de
+ * flujo a una secuencia existente.
+ */
+static bool EEPROM_ValidateConfigSet(void) {
+    Sequence seq;
+    uint32_t sequence_ok = 0; // Bit i = secuencia i utilizable
+
+    for (uint8_t s = 0; s < MAX_SEQUENCES_TOTAL; s++) {
+        EEPROM_ReadSequence(s, &seq);
+        if (seq.num_movements == 0) continue; // Registro vaco
+        if (seq.type == SEQUENCE_TYPE_DEMAND && seq.anchor_step >= seq.num_movements) return false;
+        for (uint8_t i = 0; i < seq.num_movements; i++) {
+            Movement mov;
+            if (seq.movement_indices[i] >= MAX_MOVEMENTS_TOTAL) return false;
+            EEPROM_ReadMovement(seq.movement_indices[i], &mov);
+            if (!EEPROM_IsMovementValid(&mov)) return false;
+        }
+        sequence_ok |= (uint32_t)1 << s;
+    }
+
+    for (uint8_t p = 0; p < MAX_PLANS_TOTAL; p++) {
+        Plan plan;
+        EEPROM_ReadPlan(p, &plan);
+        if (plan.id_tipo_dia > 14) continue; // Plan inactivo (mismo criterio que el scheduler)
+        if (plan.id_secuencia >= MAX_SEQUENCES_TOTAL || !(sequence_ok & ((uint32_t)1 << plan.id_secuencia))) return false;
+        if (plan.time_sel >= 5 || plan.hour > 23 || plan.minute > 59) return false;
+    }
+
+    for (uint8_t r = 0; r < MAX_FLOW_CONTROL_RULES; r++) {
+        FlowRule rule;
+        EEPROM_ReadFlowRule(r, &rule);
+        if (rule.sec_index == 0xFF) continue;
+        if (rule.sec_index >= MAX_SEQUENCES_TOTAL || !(sequence_ok & ((uint32_t)1 << rule.sec_index))) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Recalcula y guarda el CRC de la imagen por partes.
+ * @details Espera a que la cola est vaca (fin de una rfaga de guardados) y
+ * procesa EEPROM_CRC_BYTES_PER_TASK bytes por llamada.
+ */
+static void EEPROM_CRCTask(void) {
+    if (!crc_dirty || !eeprom_image_valid || txn_open) return;
+
+    if (!crc_running) {
+        if (EEPROM_GetQueueDepth() != 0) return;
+        crc_running = true;
+        crc_cursor = 0;
+        crc_accum = CRC16_INIT;
+    }
+
+    for (uint8_t n = 0; n < EEPROM_CRC_BYTES_PER_TASK && crc_cursor < EEPROM_SIZE; n++, crc_cursor++) {
+        if (!EEPROM_IsExcludedFromCRC(crc_cursor)) {
+            crc_accum = CRC16_Update(crc_accum, eeprom_mirror[crc_cursor]);
+        }
+    }
+
+    if (crc_cursor >= EEPROM_SIZE) {
+        if (EEPROM_GetQueueDepth() > EEPROM_WRITE_QUEUE_SIZE - 3) return; // Sin sitio para los 2 bytes
+        crc_running = false;
+        crc_dirty = false;
+        EEPROM_Enqueue(EEPROM_CRC_ADDR, (uint8_t)(crc_accum >> 8));
+        EEPROM_Enqueue(EEPROM_CRC_ADDR + 1, (uint8_t)(crc_accum & 0xFF));
+    }
+}
+
 void EEPROM_InitStructure(void){
+    // Tablas an sin limpiar tras un borrado de fbrica: los valores de
+    // fbrica se graban cuando EEPROM_Task() termina el barrido.
+    if (EEPROM_IsErasePending()) {
+        init_pending = true;
+        return;
+    }
+    EEPROM_WriteFactoryDefaults();
+}
+
+static void EEPROM_WriteFactoryDefaults(void){
     // 1. Definir los valores de fbrica para el Movimiento 0
     uint8_t default_times[5] = {1, 2, 3, 4, 5};
     EEPROM_SaveMovement(0, 
@@ -81,14 +703,103 @@ uint8_t EEPROM_ReadControllerID(void) {
 }
 
 /**
- * @brief Escribe 0xFF en toda la memoria EEPROM desde la direccin 0x000
- * hasta el final (EEPROM_SIZE - 1).
- * @details Este proceso puede tomar un momento en completarse.
+ * @brief Borrado de fbrica instantneo (borrado lgico).
+ * @details En lugar de grabar 0xFF en los 1024 bytes (~4 s), se invalidan todas
+ * las tablas en la cabecera y se borran la bandera de inicializacin, el ID y
+ * las mscaras. Son pocos bytes encolados; la limpieza fsica de las tablas la
+ * hace EEPROM_Task() en segundo plano.
  */
 void EEPROM_EraseAll(void) {
-    for (uint16_t i = 0; i < EEPROM_SIZE; i++) {        
-        EEPROM_Write(i, 0xFF);
+    txn_open = false; // El borrado de fbrica descarta la transaccin (y su copia)
+    txn_rollback = false;
+    EEPROM_ResealImage();
+    eeprom_valid_bitmap = (uint8_t)~EEPROM_ERASABLE_TABLES;
+    scrub_table = 1;
+    scrub_offset = 0;
+
+    EEPROM_Write(EEPROM_TABLE_VALID_ADDR, eeprom_valid_bitmap);
+    EEPROM_Write(0x000, 0xFF);
+    EEPROM_Write(EEPROM_CONTROLLER_ID_ADDR, 0xFF);
+    EEPROM_Write(EEPROM_MASK_VEHICULAR_ADDR, 0xFF);
+    EEPROM_Write(EEPROM_MASK_PEDONAL_ADDR, 0xFF);
+    EEPROM_Write(EEPROM_FLASH_STORE_STATE_ADDR, FLASH_STORE_PENDING_ERASE);
+}
+
+/**
+ * @brief Tareas de la EEPROM en segundo plano (llamada desde el bucle principal).
+ * @details Cuando el barrido termina graba los valores de fbrica que
+ * EEPROM_InitStructure() dej pendientes.
+ */
+void EEPROM_Task(void) {
+    EEPROM_RollbackTask();
+    EEPROM_CRCTask();
+    EEPROM_ScrubTask();
+
+    if (init_pending && !EEPROM_IsErasePending()) {
+        init_pending = false;
+        EEPROM_WriteFactoryDefaults();
+    }
+}
+
+/**
+ * @brief Limpieza de las tablas borradas lgicamente.
+ * @details Revisa unos pocos bytes por llamada y solo encola los que no estn
+ * ya en 0xFF; cuando una tabla queda limpia se vuelve a marcar como vlida en
+ * la cabecera.
+ */
+static void EEPROM_ScrubTask(void) {
+    uint8_t budget = EEPROM_SCRUB_BYTES_PER_TASK;
+
+    while (budget-- > 0 && eeprom_valid_bitmap != EEPROM_ALL_TABLES_VALID) {
+        if (scrub_table >= EEPROM_NUM_TABLES) {
+            scrub_table = 1;
+            scrub_offset = 0;
+        }
+        if (EEPROM_IsTableValid(scrub_table)) {
+            scrub_table++;
+            scrub_offset = 0;
+            continue;
+        }
+
+        const EEPROM_TableInfo *info = &eeprom_tables[scrub_table];
+        uint16_t table_size = (uint16_t)info->record_size * info->count;
+
+        if (scrub_offset >= table_size) {
+            // Tabla limpia: marcarla vlida (el bit se graba despus de los 0xFF encolados).
+            uint8_t new_bitmap = eeprom_valid_bitmap | (uint8_t)(1 << scrub_table);
+            if (!EEPROM_Enqueue(EEPROM_TABLE_VALID_ADDR, new_bitmap)) return; // Cola llena
+            eeprom_valid_bitmap = new_bitmap;
+            scrub_table++;
+            scrub_offset = 0;
+            continue;
+        }
+
+        if (!EEPROM_Enqueue(info->base + scrub_offset, 0xFF)) return; // Cola llena: se reintenta en la prxima llamada
+        scrub_offset++;
+    }
+}
+
+// --- Registros extendidos en flash ---
+/**
+ * @brief Lee un registro del almacn en flash; 0xFF si el ndice est fuera
+ * de rango o la regin qued pendiente de borrado tras un reset de fbrica.
+ */
+static void EEPROM_ReadExtended(uint16_t offset, uint8_t *record, uint8_t len, bool in_range) {
+    bool usable = in_range && (EEPROM_Read(EEPROM_FLASH_STORE_STATE_ADDR) != FLASH_STORE_PENDING_ERASE);
+    for (uint8_t i = 0; i < len; i++) {
+        record[i] = usable ? FlashStore_Read(offset + i) : 0xFF;
+    }
+}
+
+static bool EEPROM_WriteExtended(uint16_t offset, const uint8_t *record, uint8_t len) {
+    if (EEPROM_Read(EEPROM_FLASH_STORE_STATE_ADDR) == FLASH_STORE_PENDING_ERASE) {
+        FlashStore_EraseAll();
+        EEPROM_Write(EEPROM_FLASH_STORE_STATE_ADDR, 0xFF);
     }
+    if (txn_open && !EEPROM_TxnSaveBlocks(offset, len)) {
+        return false; // Sin copia no se podra deshacer
+    }
+    return FlashStore_Write(offset, record, len);
 }
 
 // --- Tabla de Pasos ---
@@ -99,7 +810,18 @@ void EEPROM_EraseAll(void) {
 //  Byte 1: portE
 //  Byte 2: portF
 //  Bytes 3?7: tiempos[0] a tiempos[4]
-void EEPROM_SaveMovement(uint8_t index, uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ, uint8_t *times) {
+bool EEPROM_SaveMovement(uint8_t index, uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ, uint8_t *times) {
+    if (index >= MAX_MOVEMENTS_TOTAL) return false;
+    if (index >= MAX_MOVEMENTS) {
+        uint8_t record[MOVEMENT_SIZE];
+        record[0] = portD;
+        record[1] = portE;
+        record[2] = portF;
+        record[3] = portH & VALID_PINS_H;
+        record[4] = portJ & VALID_PINS_J;
+        for (uint8_t i = 0; i < 5; i++) record[5 + i] = times[i];
+        return EEPROM_WriteExtended(FLASH_BASE_MOVEMENTS + (uint16_t)(index - MAX_MOVEMENTS) * MOVEMENT_SIZE, record, MOVEMENT_SIZE);
+    }
     uint16_t addr = EEPROM_BASE_MOVEMENTS + (index * MOVEMENT_SIZE);
     EEPROM_Write(addr,     portD);
     EEPROM_Write(addr + 1, portE);
@@ -113,35 +835,25 @@ void EEPROM_SaveMovement(uint8_t index, uint8_t portD, uint8_t portE, uint8_t po
     for(uint8_t i = 0; i < 5; i++){
         EEPROM_Write(addr + 5 + i, times[i]);
     }
+    return true;
 }
 
-void EEPROM_ReadMovement(uint8_t index, uint8_t *portD, uint8_t *portE, uint8_t *portF, uint8_t *portH, uint8_t *portJ, uint8_t *times) {
-    uint16_t addr = EEPROM_BASE_MOVEMENTS + (index * MOVEMENT_SIZE);
-    *portD = EEPROM_Read(addr);
-    *portE = EEPROM_Read(addr + 1);
-    *portF = EEPROM_Read(addr + 2);
-    *portH = EEPROM_Read(addr + 3);
-    *portJ = EEPROM_Read(addr + 4);
-
-    // Leer los 5 tiempos (ahora con un offset de 5)
-    for(uint8_t i = 0; i < 5; i++){
-        times[i] = EEPROM_Read(addr + 5 + i);
+void EEPROM_ReadMovement(uint8_t index, Movement *mov) {
+    if (index < MAX_MOVEMENTS) {
+        EEPROM_ReadBlock(EEPROM_BASE_MOVEMENTS + (index * MOVEMENT_SIZE), (uint8_t *)mov, MOVEMENT_SIZE);
+    } else {
+        EEPROM_ReadExtended(FLASH_BASE_MOVEMENTS + (uint16_t)(index - MAX_MOVEMENTS) * MOVEMENT_SIZE, (uint8_t *)mov, MOVEMENT_SIZE,
+                            index < MAX_MOVEMENTS_TOTAL);
     }
 }
 
-bool EEPROM_IsMovementValid(uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ, uint8_t *times) {
+bool EEPROM_IsMovementValid(const Movement *mov) {
     // Comprueba si los 10 bytes del movimiento estn vacos (0xFF)
-    if(portD == 0xFF && portE == 0xFF && portF == 0xFF && portH == 0xFF && portJ == 0xFF){
-        bool allTimesFF = true;
-        for(uint8_t i = 0; i < 5; i++){
-            if(times[i] != 0xFF){
-                allTimesFF = false;
-                break;
-            }
-        }
-        if(allTimesFF) return false;
+    const uint8_t *raw = (const uint8_t *)mov;
+    for (uint8_t i = 0; i < MOVEMENT_SIZE; i++) {
+        if (raw[i] != 0xFF) return true;
     }
-    return true;
+    return false;
 }
 
 // --- Tabla de Secuencias ---
@@ -150,7 +862,19 @@ bool EEPROM_IsMovementValid(uint8_t portD, uint8_t portE, uint8_t portF, uint8_t
 // Byte 1: Posicin del paso ancla (0-11)
 // Byte 2: Nmero de movimientos (n)
 // Bytes 3 a 14: ndices de los movimientos
-void EEPROM_SaveSequence(uint8_t sec_index, uint8_t type, uint8_t anchor_step_index, uint8_t num_movements, uint8_t *movements_indices) {
+// Las secuencias en flash usan un bloque de 64 bytes con hasta 24 ndices.
+bool EEPROM_SaveSequence(uint8_t sec_index, uint8_t type, uint8_t anchor_step_index, uint8_t num_movements, uint8_t *movements_indices) {
+    if (sec_index >= MAX_SEQUENCES_TOTAL) return false;
+    if (sec_index >= MAX_SEQUENCES) {
+        uint8_t record[3 + MAX_SEQUENCE_STEPS];
+        record[0] = type;
+        record[1] = anchor_step_index;
+        record[2] = num_movements;
+        for (uint8_t i = 0; i < MAX_SEQUENCE_STEPS; i++) {
+            record[3 + i] = (i < num_movements) ? movements_indices[i] : 0xFF;
+        }
+        return EEPROM_WriteExtended(FLASH_BASE_SEQUENCES + (uint16_t)(sec_index - MAX_SEQUENCES) * FLASH_SEQUENCE_SIZE, record, sizeof(record));
+    }
     uint16_t addr = EEPROM_BASE_SEQUENCES + (sec_index * SEQUENCE_SIZE);
 
     EEPROM_Write(addr,     type);              // Guardar tipo en offset +0
@@ -158,26 +882,25 @@ void EEPROM_SaveSequence(uint8_t sec_index, uint8_t type, uint8_t anchor_step_in
     EEPROM_Write(addr + 2, num_movements);      // Guardar num_mov en offset +2
 
     // Escribir los 12 bytes de los ndices de movimiento (offset +3)
-    for(uint8_t i = 0; i < 12; i++){
+    for(uint8_t i = 0; i < MAX_EEPROM_SEQUENCE_STEPS; i++){
         EEPROM_Write(addr + 3 + i, movements_indices[i]);
     }
+    return true;
 }
 
-void EEPROM_ReadSequence(uint8_t sec_index, uint8_t *type, uint8_t *anchor_step_index, uint8_t *num_movements, uint8_t *movements_indices) {
-    uint16_t addr = EEPROM_BASE_SEQUENCES + (sec_index * SEQUENCE_SIZE);
-
-    *type = EEPROM_Read(addr);                  // Leer tipo desde offset +0
-    *anchor_step_index = EEPROM_Read(addr + 1); // Leer POSICIN del ancla desde offset +1
-    *num_movements = EEPROM_Read(addr + 2);     // Leer num_mov desde offset +2
-
-    if((*num_movements == 0xFF) || (*num_movements > 12)){
-        *num_movements = 0;
-        return;
+void EEPROM_ReadSequence(uint8_t sec_index, Sequence *seq) {
+    uint8_t max_steps;
+    if (sec_index < MAX_SEQUENCES) {
+        EEPROM_ReadBlock(EEPROM_BASE_SEQUENCES + (sec_index * SEQUENCE_SIZE), (uint8_t *)seq, SEQUENCE_SIZE);
+        max_steps = MAX_EEPROM_SEQUENCE_STEPS;
+    } else {
+        EEPROM_ReadExtended(FLASH_BASE_SEQUENCES + (uint16_t)(sec_index - MAX_SEQUENCES) * FLASH_SEQUENCE_SIZE, (uint8_t *)seq, sizeof(Sequence),
+                            sec_index < MAX_SEQUENCES_TOTAL);
+        max_steps = MAX_SEQUENCE_STEPS;
     }
-
-    // Leer los ndices de movimiento (offset +3)
-    for(uint8_t i = 0; i < *num_movements; i++){
-        movements_indices[i] = EEPROM_Read(addr + 3 + i);
+    // 0xFF (registro vaco) o un nmero fuera de rango se reportan como 0 movimientos.
+    if (seq->num_movements > max_steps) {
+        seq->num_movements = 0;
     }
 }
 // --- Tabla de Planes ---
@@ -187,24 +910,30 @@ void EEPROM_ReadSequence(uint8_t sec_index, uint8_t *type, uint8_t *anchor_step_
 //  Byte 2: day (agrupacin o da de ejecucin, 1 byte)
 //  Byte 3: hour (hora de inicio, 0?23)
 //  Byte 4: minute (minuto de inicio, 0?59)
-void EEPROM_SavePlan(uint8_t plan_index, uint8_t id_tipo_dia, uint8_t sec_index, uint8_t time_sel, uint8_t hour, uint8_t minute) {
+bool EEPROM_SavePlan(uint8_t plan_index, uint8_t id_tipo_dia, uint8_t sec_index, uint8_t time_sel, uint8_t hour, uint8_t minute) {
     // La funcin usa plan_index para calcular la direccin, pero no lo guarda.
     // Solo guarda los 5 bytes de datos del plan.
+    if (plan_index >= MAX_PLANS_TOTAL) return false;
+    if (plan_index >= MAX_PLANS) {
+        uint8_t record[PLAN_SIZE] = { id_tipo_dia, sec_index, time_sel, hour, minute };
+        return EEPROM_WriteExtended(FLASH_BASE_PLANS + (uint16_t)(plan_index - MAX_PLANS) * PLAN_SIZE, record, PLAN_SIZE);
+    }
     uint16_t addr = EEPROM_BASE_PLANS + (plan_index * PLAN_SIZE);
     EEPROM_Write(addr,     id_tipo_dia);
     EEPROM_Write(addr + 1, sec_index);
     EEPROM_Write(addr + 2, time_sel);
     EEPROM_Write(addr + 3, hour);
     EEPROM_Write(addr + 4, minute);
+    return true;
 }
 
-void EEPROM_ReadPlan(uint8_t plan_index, uint8_t *id_tipo_dia, uint8_t *sec_index, uint8_t *time_sel, uint8_t *hour, uint8_t *minute) {
-    uint16_t addr = EEPROM_BASE_PLANS + (plan_index * PLAN_SIZE);
-    *id_tipo_dia = EEPROM_Read(addr);
-    *sec_index  = EEPROM_Read(addr + 1);
-    *time_sel  = EEPROM_Read(addr + 2);
-    *hour      = EEPROM_Read(addr + 3);
-    *minute    = EEPROM_Read(addr + 4);
+void EEPROM_ReadPlan(uint8_t plan_index, Plan *plan) {
+    if (plan_index < MAX_PLANS) {
+        EEPROM_ReadBlock(EEPROM_BASE_PLANS + (plan_index * PLAN_SIZE), (uint8_t *)plan, PLAN_SIZE);
+    } else {
+        EEPROM_ReadExtended(FLASH_BASE_PLANS + (uint16_t)(plan_index - MAX_PLANS) * PLAN_SIZE, (uint8_t *)plan, PLAN_SIZE,
+                            plan_index < MAX_PLANS_TOTAL);
+    }
 }
 
 void EEPROM_SaveHoliday(uint8_t index, uint8_t day, uint8_t month) {
@@ -249,7 +978,11 @@ void EEPROM_ReadIntermittence(uint8_t index, uint8_t *id_plan, uint8_t *indice_m
     *mask_f = EEPROM_Read(addr + 4);
 }
 
-void EEPROM_SaveFlowRule(uint8_t rule_index, uint8_t sec_index, uint8_t origin_mov_index, uint8_t rule_type, uint8_t demand_mask, uint8_t dest_mov_index) {
+// --- Tabla de Control de Flujo ---
+// Cada regla ocupa 6 bytes:
+// Byte 0: sec_index, Byte 1: movimiento de origen, Byte 2: rule_type,
+// Byte 3: mscara de demandas, Byte 4: destino (paso o N), Byte 5: accin
+void EEPROM_SaveFlowRule(uint8_t rule_index, uint8_t sec_index, uint8_t origin_mov_index, uint8_t rule_type, uint8_t demand_mask, uint8_t dest_mov_index, uint8_t action) {
     if (rule_index >= MAX_FLOW_CONTROL_RULES) return;
     uint16_t addr = EEPROM_BASE_FLOW_CONTROL + (rule_index * FLOW_CONTROL_RULE_SIZE);
     EEPROM_Write(addr,     sec_index);
@@ -257,20 +990,15 @@ void EEPROM_SaveFlowRule(uint8_t rule_index, uint8_t sec_index, uint8_t origin_m
     EEPROM_Write(addr + 2, rule_type);
     EEPROM_Write(addr + 3, demand_mask);
     EEPROM_Write(addr + 4, dest_mov_index);
-    EEPROM_Write(addr + 5, 0xFF);
+    EEPROM_Write(addr + 5, action);
 }
 
-void EEPROM_ReadFlowRule(uint8_t rule_index, uint8_t *sec_index, uint8_t *origin_mov_index, uint8_t *rule_type, uint8_t *demand_mask, uint8_t *dest_mov_index) {
+void EEPROM_ReadFlowRule(uint8_t rule_index, FlowRule *rule) {
     if (rule_index >= MAX_FLOW_CONTROL_RULES) {
-        *sec_index = 0xFF;
+        rule->sec_index = 0xFF;
         return;
     }
-    uint16_t addr = EEPROM_BASE_FLOW_CONTROL + (rule_index * FLOW_CONTROL_RULE_SIZE);
-    *sec_index = EEPROM_Read(addr);
-    *origin_mov_index = EEPROM_Read(addr + 1);
-    *rule_type = EEPROM_Read(addr + 2);
-    *demand_mask = EEPROM_Read(addr + 3);
-    *dest_mov_index = EEPROM_Read(addr + 4);
+    EEPROM_ReadBlock(EEPROM_BASE_FLOW_CONTROL + (rule_index * FLOW_CONTROL_RULE_SIZE), (uint8_t *)rule, FLOW_CONTROL_RULE_SIZE);
 }
 
 //Funciones para guardar y leer las salidas que seran utilizadas en la configuracion total.
@@ -282,4 +1010,14 @@ void EEPROM_SaveOutputMasks(uint8_t mask_veh, uint8_t mask_ped) {
 void EEPROM_ReadOutputMasks(uint8_t *mask_veh, uint8_t *mask_ped) {
     *mask_veh = EEPROM_Read(EEPROM_MASK_VEHICULAR_ADDR);
     *mask_ped = EEPROM_Read(EEPROM_MASK_PEDONAL_ADDR);
-}
\ No newline at end of file
+}
+
+void EEPROM_SaveBusConfig(uint8_t mode, uint8_t group) {
+    EEPROM_Write(EEPROM_BUS_MODE_ADDR, mode);
+    EEPROM_Write(EEPROM_BUS_GROUP_ADDR, group);
+}
+
+void EEPROM_ReadBusConfig(uint8_t *mode, uint8_t *group) {
+    *mode = EEPROM_Read(EEPROM_BUS_MODE_ADDR);
+    *group = EEPROM_Read(EEPROM_BUS_GROUP_ADDR);
+}
@@ -15,8 +15,20 @@
 #define SEQUENCE_TYPE_DEMAND    0x01
 
 // --- TIPOS DE REGLA PARA CONTROL DE FLUJO ---
+// Varias reglas pueden compartir el mismo movimiento de origen; se evalan en
+// orden de ndice (prioridad) y gana la primera cuya condicin se cumple.
+// Excepcin: una regla RULE_ACTION_LEGACY decide sola aunque no se cumpla,
+// como en el formato original (primera regla del origen).
 #define RULE_TYPE_GOTO            0x00 // Salto incondicional
-#define RULE_TYPE_DECISION_POINT  0x01 // Salto condicional (Punto de Decisin)
+#define RULE_TYPE_DECISION_POINT  0x01 // Salto condicional (Punto de Decisin): ALGUNA demanda de la mscara
+#define RULE_TYPE_DECISION_ANY    RULE_TYPE_DECISION_POINT
+#define RULE_TYPE_DECISION_ALL    0x02 // TODAS las demandas de la mscara activas
+#define RULE_TYPE_DECISION_NONE   0x03 // NINGUNA demanda de la mscara activa
+
+// --- ACCIN DE LA REGLA (byte 5 del registro) ---
+#define RULE_ACTION_LEGACY        0xFF // Registros antiguos: GOTO_STEP sin reglas de respaldo
+#define RULE_ACTION_GOTO_STEP     0x00 // dest = posicin del paso destino
+#define RULE_ACTION_SKIP_STEPS    0x01 // dest = N pasos a saltar despus del siguiente
 
 
 // =============================================================================
@@ -55,11 +67,109 @@
 #define FLOW_CONTROL_RULE_SIZE    6
 #define MAX_FLOW_CONTROL_RULES    10
 
+// --- TABLAS EXTENDIDAS EN MEMORIA DE PROGRAMA (flash_store.h) ---
+// Los ndices por encima de los lmites de la EEPROM se guardan en flash con
+// el mismo formato de registro; el resto del firmware usa los lmites _TOTAL.
+#define MAX_MOVEMENTS_TOTAL        192 // 0..59 en EEPROM, 60..191 en flash
+#define MAX_SEQUENCES_TOTAL        24  // 0..7 en EEPROM, 8..23 en flash
+#define MAX_PLANS_TOTAL            48  // 0..19 en EEPROM, 20..47 en flash
+#define MAX_EEPROM_SEQUENCE_STEPS  12  // Pasos de una secuencia en EEPROM
+#define MAX_SEQUENCE_STEPS         24  // Pasos de una secuencia en flash
+
+#define FLASH_BASE_MOVEMENTS       0x0000 // 132 x 10 bytes
+#define FLASH_BASE_SEQUENCES       0x0540 // 16 x 64 bytes (un bloque de borrado por secuencia)
+#define FLASH_SEQUENCE_SIZE        64     // tipo, ancla, num_mov, 24 ndices, relleno
+#define FLASH_BASE_PLANS           0x0940 // 28 x 5 bytes
+
+// Copia de respaldo de la transaccin de configuracin (ver ms abajo)
+#define FLASH_TXN_RECORDS_SIZE     0x0A00 // Bloques 0x0000..0x09FF de registros extendidos
+#define FLASH_BASE_TXN_RECORDS     0x2000 // Copia de los bloques tocados en la transaccin
+#define FLASH_BASE_TXN_EEPROM      0x3000 // Copia de la EEPROM completa (1 KB)
+
+// Estado del almacn en flash (byte libre de la cabecera). Tras un borrado de
+// fbrica vale FLASH_STORE_PENDING_ERASE: las lecturas devuelven 0xFF y la
+// primera escritura borra la regin completa.
+#define EEPROM_FLASH_STORE_STATE_ADDR 0x003
+#define FLASH_STORE_PENDING_ERASE     0x00
+
+// --- CABECERA DE VALIDEZ DE TABLAS ---
+// Bit t = 1: la tabla t (EEPROM_Table) tiene contenido vivo. Una EEPROM sin
+// formatear (0xFF) tiene todas las tablas vlidas.
+#define EEPROM_TABLE_VALID_ADDR   0x002
+#define EEPROM_ALL_TABLES_VALID   0xFF
+#define EEPROM_SCRUB_BYTES_PER_TASK 8
+
+// --- CRC DE LA IMAGEN (2 bytes, MSB primero) ---
+// 0xFFFF = imagen sin sellar (EEPROM anterior a esta versin).
+#define EEPROM_CRC_ADDR           0x004
+
+// --- LOG DE ESTADO EN TIEMPO DE EJECUCIN ---
+// Ranuras en huecos libres: 0x008, 0x010, 0x018, 0x278 y 0x3F8 (8 bytes c/u).
+#define EEPROM_RUNTIME_LOG_SLOTS       5
+#define EEPROM_RUNTIME_LOG_RECORD_SIZE 8
+
 // --- MAPA DE MSCARAS DE SALIDA --- 
 // (Ubicado en el espacio libre de 2 bytes)
 #define EEPROM_MASK_VEHICULAR_ADDR 0x3BA
 #define EEPROM_MASK_PEDONAL_ADDR   0x3BB
 
+// --- DIRECCIONAMIENTO EN BUS RS-485 (UART1) ---
+// Modo 0xFF (EEPROM borrada) = enlace punto a punto con tramas sin direccin.
+#define EEPROM_BUS_MODE_ADDR       0x006
+#define EEPROM_BUS_GROUP_ADDR      0x007
+
+// --- TABLAS PARA LA CONTABILIDAD DE ESCRITURAS ---
+typedef enum {
+    EEPROM_TABLE_SYSTEM = 0,      // Bandera de inicio, ID, mscaras y zonas libres
+    EEPROM_TABLE_MOVEMENTS,
+    EEPROM_TABLE_SEQUENCES,
+    EEPROM_TABLE_PLANS,
+    EEPROM_TABLE_INTERMITENCES,
+    EEPROM_TABLE_HOLIDAYS,
+    EEPROM_TABLE_FLOW_CONTROL,
+    EEPROM_NUM_TABLES
+} EEPROM_Table;
+
+// Estado que se anota peridicamente en el log
+typedef struct {
+    int8_t plan_id;     // ltimo plan en ejecucin (-1 = ninguno)
+    uint8_t step;       // Paso de la secuencia al anotar
+    uint16_t cycles;    // Ciclos completos ejecutados
+    uint16_t faults;    // Cadas a fallback por datos invlidos
+} RuntimeState;
+
+// --- REGISTROS TIPADOS ---
+// Mismo orden de bytes que en la EEPROM/flash: se rellenan con una sola
+// lectura en bloque (todos los campos son uint8_t, sin relleno).
+typedef struct {
+    uint8_t ports[5];   // D, E, F, H, J
+    uint8_t times[5];   // Tiempos por selector
+} Movement;
+
+typedef struct {
+    uint8_t type;           // SEQUENCE_TYPE_*
+    uint8_t anchor_step;    // POSICIN del paso ancla
+    uint8_t num_movements;  // 0 = registro vaco
+    uint8_t movement_indices[MAX_SEQUENCE_STEPS];
+} Sequence;
+
+typedef struct {
+    uint8_t id_tipo_dia;
+    uint8_t id_secuencia;
+    uint8_t time_sel;
+    uint8_t hour;
+    uint8_t minute;
+} Plan;
+
+typedef struct {
+    uint8_t sec_index;   // 0xFF = regla vaca
+    uint8_t origin_mov;
+    uint8_t type;        // RULE_TYPE_*
+    uint8_t mask;
+    uint8_t dest;
+    uint8_t action;      // RULE_ACTION_*
+} FlowRule;
+
 // =============================================================================
 // --- PROTOTIPOS DE FUNCIONES (REVISADOS) ---
 // =============================================================================
@@ -67,22 +177,166 @@
 void EEPROM_Init(void);
 void EEPROM_Write(uint16_t addr, uint8_t data);
 uint8_t EEPROM_Read(uint16_t addr);
+
+/**
+ * @brief Lectura secuencial de un registro completo (direccin autoincremental).
+ * @details Resuelve el borrado lgico una sola vez para todo el bloque, por lo
+ * que el rango debe quedar dentro de un nico registro.
+ */
+void EEPROM_ReadBlock(uint16_t addr, uint8_t *dest, uint8_t len);
+
+// --- COLA DE ESCRITURA ASNCRONA ---
+/**
+ * @brief Encola la escritura de un byte sin bloquear.
+ * @return false si la cola est llena o la tabla espera la limpieza de un
+ * borrado de fbrica (el byte NO se encol).
+ */
+bool EEPROM_WriteAsync(uint16_t addr, uint8_t data);
+
+/**
+ * @brief Barrera: espera a que todas las escrituras encoladas estn grabadas.
+ */
+void EEPROM_Flush(void);
+
+/**
+ * @brief Nmero de escrituras pendientes (incluida la que est en curso).
+ */
+uint8_t EEPROM_GetQueueDepth(void);
+
+/**
+ * @brief Marca de la ltima escritura encolada. Cuando EEPROM_IsWriteDone()
+ * la da por grabada, tambin lo estn todas las encoladas antes.
+ */
+uint16_t EEPROM_GetWriteTicket(void);
+bool EEPROM_IsWriteDone(uint16_t ticket);
+
+// Resultado de EEPROM_VerifyRecord
+#define EEPROM_VERIFY_OK       0
+#define EEPROM_VERIFY_MISMATCH 1
+#define EEPROM_VERIFY_BUSY     2 // Grabacin en curso: reintentar ms tarde
+
+/**
+ * @brief Relee un registro de la EEPROM fsica y lo compara con el espejo.
+ * @details Con EEPROM_TABLE_SYSTEM se relee la cabecera (bandera, ID, validez
+ * y estado de la flash). Los registros guardados en flash dan OK: ya se
+ * releyeron al grabarlos. Los bytes con una escritura an en cola no se
+ * comparan. Nunca espera a la grabacin en curso: devuelve
+ * EEPROM_VERIFY_BUSY.
+ */
+uint8_t EEPROM_VerifyRecord(uint8_t table, uint8_t index);
+
+/**
+ * @brief Manejador de fin de escritura (EEIF). Llamada desde la ISR en timers.c.
+ */
+void EEPROM_WriteComplete_ISR(void);
+
+// --- CONTABILIDAD DE ESCRITURAS (comparar antes de escribir) ---
+/**
+ * @brief Devuelve cuntos bytes se grabaron y cuntos se omitieron por ser
+ * idnticos al contenido actual, para una tabla del mapa.
+ */
+void EEPROM_GetWriteStats(uint8_t table, uint16_t *performed, uint16_t *skipped);
+void EEPROM_ResetWriteStats(void);
 void EEPROM_EraseAll(void);
+void EEPROM_Task(void);
+/**
+ * @brief Indica si alguna tabla espera an la limpieza de un borrado de fbrica.
+ * @details Mientras tanto esas tablas no admiten escrituras (unos 4 s como mucho).
+ */
+bool EEPROM_IsErasePending(void);
+
+// --- INTEGRIDAD DE LA IMAGEN (espejo en RAM + CRC) ---
+/**
+ * @brief Indica si el CRC verificado al arrancar coincide con el contenido.
+ * @details Con la imagen invlida el scheduler no arranca ningn plan (fallback).
+ */
+bool EEPROM_IsImageValid(void);
+
+/**
+ * @brief Acepta el contenido actual como bueno y vuelve a sellar el CRC.
+ */
+void EEPROM_ResealImage(void);
+uint16_t EEPROM_GetStoredCRC(void);
+
+// --- TRANSACCIN DE CONFIGURACIN ---
+// Mientras est abierta, la EEPROM acta como rea de preparacin: el motor
+// sigue ejecutando la tabla ya compilada en RAM, el scheduler no cambia de
+// plan y el CRC no se vuelve a sellar (un corte de energa a mitad de la
+// carga deja la imagen invlida en lugar de mezclada).
+// Al abrirla se copia la EEPROM a FLASH_BASE_TXN_EEPROM, y cada bloque de
+// registros extendidos se copia a FLASH_BASE_TXN_RECORDS antes de su primera
+// escritura. Abortar (o agotar el tiempo) restaura esas copias en segundo
+// plano, as la configuracin anterior sigue en marcha.
+#define CONFIG_TXN_TIMEOUT_S 300 // Sin confirmar en este tiempo se aborta sola
+#define EEPROM_ROLLBACK_BYTES_PER_TASK 32
+
+/**
+ * @brief Abre la transaccin y guarda la copia de respaldo de la EEPROM.
+ * @details Bloquea mientras graba los bloques de flash que cambiaron desde la
+ * copia anterior (hasta 16, unos 18 ms cada uno).
+ * @return false si ya hay una abierta, si un borrado de fbrica an se est
+ * limpiando o si la copia no se verific.
+ */
+bool EEPROM_BeginTransaction(void);
+bool EEPROM_IsTransactionOpen(void);
+
+/**
+ * @brief true mientras se restaura la configuracin anterior tras un aborto
+ * (la transaccin sigue contando como abierta hasta terminar).
+ */
+bool EEPROM_IsRollbackActive(void);
+
+/**
+ * @brief Devuelve true una sola vez al terminar una restauracin, para que el
+ * bucle principal recargue las cachs del scheduler y del motor.
+ */
+bool EEPROM_TakeRollbackDone(void);
+
+/**
+ * @brief Valida las referencias cruzadas de la configuracin preparada y, si
+ * es coherente, cierra la transaccin y vuelve a sellar el CRC.
+ * @return false si la validacin falla (la transaccin sigue abierta).
+ */
+bool EEPROM_CommitTransaction(void);
+
+/**
+ * @brief Descarta la transaccin: EEPROM_Task() restaura la copia de respaldo
+ * y despus la cierra. La imagen conserva la validez que tena al abrirla.
+ */
+void EEPROM_AbortTransaction(void);
+
+/**
+ * @brief Cuenta el tiempo de la transaccin abierta (llamar cada segundo).
+ */
+void EEPROM_TransactionTick(void);
+
+// --- LOG DE ESTADO (nivelacin de desgaste) ---
+/**
+ * @brief Recupera la anotacin ms reciente encontrada al arrancar.
+ * @return false si el log est vaco.
+ */
+bool EEPROM_LogLoad(RuntimeState *state);
+
+/**
+ * @brief Aade una anotacin en la siguiente ranura (O(1), va cola de escritura).
+ */
+void EEPROM_LogAppend(const RuntimeState *state);
 void EEPROM_InitStructure(void);
 
 void EEPROM_SaveControllerID(uint8_t id);
 uint8_t EEPROM_ReadControllerID(void);
 
-void EEPROM_SaveMovement(uint8_t index, uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ, uint8_t *times);
-void EEPROM_ReadMovement(uint8_t index, uint8_t *portD, uint8_t *portE, uint8_t *portF, uint8_t *portH, uint8_t *portJ, uint8_t *times);
-bool EEPROM_IsMovementValid(uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ, uint8_t *times);
+// Los guardados devuelven false si el ndice est fuera de rango o la flash no se verific.
+bool EEPROM_SaveMovement(uint8_t index, uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ, uint8_t *times);
+void EEPROM_ReadMovement(uint8_t index, Movement *mov);
+bool EEPROM_IsMovementValid(const Movement *mov);
 
 // MODIFICADAS: Aadido 'type' y 'anchor_mov_index'
-void EEPROM_SaveSequence(uint8_t sec_index, uint8_t type, uint8_t anchor_step_index, uint8_t num_movements, uint8_t *movements_indices);
-void EEPROM_ReadSequence(uint8_t sec_index, uint8_t *type, uint8_t *anchor_step_index, uint8_t *num_movements, uint8_t *movements_indices);
+bool EEPROM_SaveSequence(uint8_t sec_index, uint8_t type, uint8_t anchor_step_index, uint8_t num_movements, uint8_t *movements_indices);
+void EEPROM_ReadSequence(uint8_t sec_index, Sequence *seq);
 
-void EEPROM_SavePlan(uint8_t plan_index, uint8_t id_tipo_dia, uint8_t sec_index, uint8_t time_sel, uint8_t hour, uint8_t minute);
-void EEPROM_ReadPlan(uint8_t plan_index, uint8_t *id_tipo_dia, uint8_t *sec_index, uint8_t *time_sel, uint8_t *hour, uint8_t *minute);
+bool EEPROM_SavePlan(uint8_t plan_index, uint8_t id_tipo_dia, uint8_t sec_index, uint8_t time_sel, uint8_t hour, uint8_t minute);
+void EEPROM_ReadPlan(uint8_t plan_index, Plan *plan);
 
 void EEPROM_SaveIntermittence(uint8_t index, uint8_t id_plan, uint8_t indice_mov, uint8_t mask_d, uint8_t mask_e, uint8_t mask_f);
 void EEPROM_ReadIntermittence(uint8_t index, uint8_t *id_plan, uint8_t *indice_mov, uint8_t *mask_d, uint8_t *mask_e, uint8_t *mask_f);
@@ -91,8 +345,8 @@ void EEPROM_SaveHoliday(uint8_t index, uint8_t day, uint8_t month);
 void EEPROM_ReadHoliday(uint8_t index, uint8_t *day, uint8_t *month);
 
 // --- NUEVAS FUNCIONES PARA CONTROL DE FLUJO ---
-void EEPROM_SaveFlowRule(uint8_t rule_index, uint8_t sec_index, uint8_t origin_mov_index, uint8_t rule_type, uint8_t demand_mask, uint8_t dest_mov_index);
-void EEPROM_ReadFlowRule(uint8_t rule_index, uint8_t *sec_index, uint8_t *origin_mov_index, uint8_t *rule_type, uint8_t *demand_mask, uint8_t *dest_mov_index);
+void EEPROM_SaveFlowRule(uint8_t rule_index, uint8_t sec_index, uint8_t origin_mov_index, uint8_t rule_type, uint8_t demand_mask, uint8_t dest_mov_index, uint8_t action);
+void EEPROM_ReadFlowRule(uint8_t rule_index, FlowRule *rule);
 
 // FUNCIONES DE MSCARAS DE SALIDA --- 
 /**
@@ -109,5 +363,11 @@ void EEPROM_SaveOutputMasks(uint8_t mask_veh, uint8_t mask_ped);
  */
 void EEPROM_ReadOutputMasks(uint8_t *mask_veh, uint8_t *mask_ped);
 
+/**
+ * @brief Guarda el modo de trama de UART1 y la direccin de grupo del controlador.
+ */
+void EEPROM_SaveBusConfig(uint8_t mode, uint8_t group);
+void EEPROM_ReadBusConfig(uint8_t *mode, uint8_t *group);
+
 
 #endif // EEPROM_H
@@ -0,0 +1,130 @@
+// flash_store.c
+#include <xc.h>
+#include "flash_store.h"
+#include "eeprom.h"
+
+// Copia en RAM del bloque que se est modificando.
+static uint8_t flash_block[FLASH_ERASE_BLOCK_SIZE];
+
+static void FlashStore_SetPointer(uint32_t addr) {
+    TBLPTRU = (uint8_t)(addr >> 16);
+    TBLPTRH = (uint8_t)(addr >> 8);
+    TBLPTRL = (uint8_t)addr;
+}
+
+/**
+ * @brief Secuencia de desbloqueo y arranque de la operacin en EECON1.
+ * @details La CPU se detiene hasta que el borrado o la escritura terminan.
+ */
+static void FlashStore_Unlock(void) {
+    uint8_t gie = INTCONbits.GIE;
+    INTCONbits.GIE = 0;
+    EECON2 = 0x55;
+    EECON2 = 0xAA;
+    EECON1bits.WR = 1;
+    NOP();
+    INTCONbits.GIE = gie;
+}
+
+static void FlashStore_EraseBlock(uint32_t addr) {
+    FlashStore_SetPointer(addr);
+    EECON1bits.EEPGD = 1;
+    EECON1bits.CFGS = 0;
+    EECON1bits.WREN = 1;
+    EECON1bits.FREE = 1;
+    FlashStore_Unlock();
+    EECON1bits.WREN = 0;
+}
+
+/**
+ * @brief Borra el bloque de 64 bytes y lo regraba desde flash_block.
+ */
+static void FlashStore_WriteBlock(uint32_t addr) {
+    FlashStore_EraseBlock(addr);
+    FlashStore_SetPointer(addr);
+    for (uint8_t group = 0; group < FLASH_ERASE_BLOCK_SIZE; group += FLASH_WRITE_BLOCK_SIZE) {
+        // Cargar los 8 registros de retencin
+        for (uint8_t i = 0; i < FLASH_WRITE_BLOCK_SIZE; i++) {
+            TABLAT = flash_block[group + i];
+            asm("TBLWT*+");
+        }
+        asm("TBLRD*-"); // Volver dentro del grupo para que la escritura caiga en l
+        EECON1bits.EEPGD = 1;
+        EECON1bits.CFGS = 0;
+        EECON1bits.FREE = 0;
+        EECON1bits.WREN = 1;
+        FlashStore_Unlock();
+        EECON1bits.WREN = 0;
+        asm("TBLRD*+");
+        CLRWDT();
+    }
+}
+
+uint8_t FlashStore_Read(uint16_t offset) {
+    FlashStore_SetPointer(FLASH_STORE_BASE + offset);
+    asm("TBLRD*");
+    return TABLAT;
+}
+
+bool FlashStore_Write(uint16_t offset, const uint8_t *data, uint8_t len) {
+    if ((uint32_t)offset + len > FLASH_STORE_SIZE) return false;
+
+    bool ok = true;
+    EEPROM_Flush();
+    while (len > 0) {
+        uint16_t block_offset = offset & ~(uint16_t)(FLASH_ERASE_BLOCK_SIZE - 1);
+        uint8_t pos = (uint8_t)(offset - block_offset);
+        bool changed = false;
+
+        for (uint8_t i = 0; i < FLASH_ERASE_BLOCK_SIZE; i++) {
+            flash_block[i] = FlashStore_Read(block_offset + i);
+        }
+        while (len > 0 && pos < FLASH_ERASE_BLOCK_SIZE) {
+            if (flash_block[pos] != *data) {
+                flash_block[pos] = *data;
+                changed = true;
+            }
+            pos++; data++; offset++; len--;
+        }
+        if (changed) {
+            FlashStore_WriteBlock(FLASH_STORE_BASE + block_offset);
+            for (uint8_t i = 0; i < FLASH_ERASE_BLOCK_SIZE; i++) {
+                if (FlashStore_Read(block_offset + i) != flash_block[i]) ok = false;
+            }
+        }
+    }
+    EECON1bits.EEPGD = 0; // Dejar EECON1 apuntando a la EEPROM de datos
+    return ok;
+}
+
+bool FlashStore_CopyBlock(uint16_t dst_offset, uint16_t src_offset) {
+    bool changed = false;
+    EEPROM_Flush();
+    for (uint8_t i = 0; i < FLASH_ERASE_BLOCK_SIZE; i++) {
+        flash_block[i] = FlashStore_Read(src_offset + i);
+        if (FlashStore_Read(dst_offset + i) != flash_block[i]) changed = true;
+    }
+    bool ok = true;
+    if (changed) {
+        FlashStore_WriteBlock(FLASH_STORE_BASE + dst_offset);
+        for (uint8_t i = 0; i < FLASH_ERASE_BLOCK_SIZE; i++) {
+            if (FlashStore_Read(dst_offset + i) != flash_block[i]) ok = false;
+        }
+    }
+    EECON1bits.EEPGD = 0;
+    return ok;
+}
+
+void FlashStore_EraseAll(void) {
+    EEPROM_Flush();
+    for (uint16_t offset = 0; offset < FLASH_STORE_SIZE; offset += FLASH_ERASE_BLOCK_SIZE) {
+        bool blank = true;
+        for (uint8_t i = 0; i < FLASH_ERASE_BLOCK_SIZE && blank; i++) {
+            blank = (FlashStore_Read(offset + i) == 0xFF);
+        }
+        if (blank) continue; // Solo se borran los bloques usados
+        FlashStore_EraseBlock(FLASH_STORE_BASE + offset);
+        CLRWDT();
+    }
+    EECON1bits.EEPGD = 0;
+}
@@ -0,0 +1,46 @@
+// flash_store.h
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// --- ALMACN DE CONFIGURACIN EN MEMORIA DE PROGRAMA ---
+// Regin reservada al final de la flash (el enlazador la excluye con
+// -mrom=default,-1C000-1FFFF). Guarda los registros que no caben en la EEPROM
+// de 1 KB: movimientos, secuencias largas y planes extendidos.
+// En el PIC18F8720 la flash se borra en bloques de 64 bytes y se escribe en
+// grupos de 8, as que cada escritura es lectura-modificacin-borrado-escritura
+// de un bloque completo. La CPU queda detenida unos 2 ms por operacin.
+#define FLASH_STORE_BASE        0x1C000UL
+#define FLASH_STORE_SIZE        0x4000U
+#define FLASH_ERASE_BLOCK_SIZE  64
+#define FLASH_WRITE_BLOCK_SIZE  8
+
+/**
+ * @brief Lee un byte del almacn (lectura de tabla, sin esperas).
+ * @param offset Desplazamiento dentro de la regin (0..FLASH_STORE_SIZE-1).
+ */
+uint8_t FlashStore_Read(uint16_t offset);
+
+/**
+ * @brief Escribe un rango dentro del almacn.
+ * @details Solo borra y regraba los bloques de 64 bytes cuyo contenido cambia.
+ * Vaca antes la cola de la EEPROM, ya que ambas comparten EECON1.
+ * @return false si el rango no cabe o un bloque no se relee igual tras grabarlo.
+ */
+bool FlashStore_Write(uint16_t offset, const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Copia un bloque de 64 bytes del almacn sobre otro (ambos alineados).
+ * @details Solo regraba el destino si difiere. Vaca antes la cola de la EEPROM.
+ * @return false si el destino no se relee igual tras grabarlo.
+ */
+bool FlashStore_CopyBlock(uint16_t dst_offset, uint16_t src_offset);
+
+/**
+ * @brief Borra toda la regin (restablecimiento de fbrica). Bloqueante.
+ */
+void FlashStore_EraseAll(void);
+
+#endif // FLASH_STORE_H
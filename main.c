@@ -65,6 +65,7 @@ static void HandleManualFlashSwitch(void) {
         }
     } else if (release_counter == DEBOUNCE_THRESHOLD) {
         if (g_manual_flash_active) {
+            EEPROM_Flush(); // No perder escrituras encoladas con el reinicio
             while(1) { /* Esperar reinicio por WDT */ }
         }
     }
@@ -77,15 +78,18 @@ void main(void) {
     RTC_Init();
     Sequence_Engine_Init();
     Scheduler_Init();
-    UART1_Init(9600);
-    UART2_Init(9600);
+    UART1_Init(UART_DEFAULT_BAUD);
+    UART2_Init(UART_DEFAULT_BAUD);
     Timers_Init();
 
     if (EEPROM_Read(0x000) != 0xAA) {
-        UART1_SendString("EEPROM no inicializada. Formateando...\r\n");
+        UART_Send_Event(EVT_EEPROM_FORMATTED, 0, 0);
         EEPROM_InitStructure();
     }
-    UART1_SendString("Controlador semaforico CORMAR inicializado\r\n");
+    if (!EEPROM_IsImageValid()) {
+        UART_Send_Event(EVT_CONFIG_CRC_INVALID, 0, 0);
+    }
+    UART_Send_Event(EVT_BOOT, EEPROM_ReadControllerID(), 0);
 
     g_system_ready = true;
 
@@ -101,13 +105,31 @@ void main(void) {
             UART_Task();
             UART2_Task();
         }
+        EEPROM_Task();
+        if (EEPROM_TakeRollbackDone()) {
+            // Transaccin abortada: las cachs vuelven a la configuracin anterior
+            Scheduler_ReloadCache();
+            Sequence_Engine_ReloadStepTable();
+        }
 
+        bool tenth_tick = g_tenth_second_flag;
         bool half_tick = g_half_second_flag;
         bool sec_tick = g_one_second_flag;
 
+        if (tenth_tick) g_tenth_second_flag = false;
         if (half_tick) g_half_second_flag = false;
         if (sec_tick) g_one_second_flag = false;
 
+        if (tenth_tick) {
+            UART_TelemetryTick();
+        }
+
+        if (sec_tick) {
+            EEPROM_TransactionTick();
+            UART_BaudTick();
+            UART_FrameCheckTick();
+        }
+
         if (sec_tick && !g_manual_flash_active) {
             Scheduler_Task();
         }
@@ -115,5 +137,8 @@ void main(void) {
         if (half_tick || sec_tick) {
             Sequence_Engine_Run(half_tick, sec_tick);
         }
+
+        // Tras cualquier cambio de LAT de esta pasada (motor o destello manual)
+        UART2_OutputService();
     }
 }
\ No newline at end of file
@@ -51,17 +51,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=config.c eeprom.c main.c rtc.c timers.c uart.c scheduler.c sequence_engine.c
+SOURCEFILES_QUOTED_IF_SPACED=config.c eeprom.c main.c rtc.c timers.c uart.c scheduler.c sequence_engine.c crc16.c flash_store.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/config.p1 ${OBJECTDIR}/eeprom.p1 ${OBJECTDIR}/main.p1 ${OBJECTDIR}/rtc.p1 ${OBJECTDIR}/timers.p1 ${OBJECTDIR}/uart.p1 ${OBJECTDIR}/scheduler.p1 ${OBJECTDIR}/sequence_engine.p1
-POSSIBLE_DEPFILES=${OBJECTDIR}/config.p1.d ${OBJECTDIR}/eeprom.p1.d ${OBJECTDIR}/main.p1.d ${OBJECTDIR}/rtc.p1.d ${OBJECTDIR}/timers.p1.d ${OBJECTDIR}/uart.p1.d ${OBJECTDIR}/scheduler.p1.d ${OBJECTDIR}/sequence_engine.p1.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/config.p1 ${OBJECTDIR}/eeprom.p1 ${OBJECTDIR}/main.p1 ${OBJECTDIR}/rtc.p1 ${OBJECTDIR}/timers.p1 ${OBJECTDIR}/uart.p1 ${OBJECTDIR}/scheduler.p1 ${OBJECTDIR}/sequence_engine.p1 ${OBJECTDIR}/crc16.p1 ${OBJECTDIR}/flash_store.p1
+POSSIBLE_DEPFILES=${OBJECTDIR}/config.p1.d ${OBJECTDIR}/eeprom.p1.d ${OBJECTDIR}/main.p1.d ${OBJECTDIR}/rtc.p1.d ${OBJECTDIR}/timers.p1.d ${OBJECTDIR}/uart.p1.d ${OBJECTDIR}/scheduler.p1.d ${OBJECTDIR}/sequence_engine.p1.d ${OBJECTDIR}/crc16.p1.d ${OBJECTDIR}/flash_store.p1.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/config.p1 ${OBJECTDIR}/eeprom.p1 ${OBJECTDIR}/main.p1 ${OBJECTDIR}/rtc.p1 ${OBJECTDIR}/timers.p1 ${OBJECTDIR}/uart.p1 ${OBJECTDIR}/scheduler.p1 ${OBJECTDIR}/sequence_engine.p1
+OBJECTFILES=${OBJECTDIR}/config.p1 ${OBJECTDIR}/eeprom.p1 ${OBJECTDIR}/main.p1 ${OBJECTDIR}/rtc.p1 ${OBJECTDIR}/timers.p1 ${OBJECTDIR}/uart.p1 ${OBJECTDIR}/scheduler.p1 ${OBJECTDIR}/sequence_engine.p1 ${OBJECTDIR}/crc16.p1 ${OBJECTDIR}/flash_store.p1
 
 # Source Files
-SOURCEFILES=config.c eeprom.c main.c rtc.c timers.c uart.c scheduler.c sequence_engine.c
+SOURCEFILES=config.c eeprom.c main.c rtc.c timers.c uart.c scheduler.c sequence_engine.c crc16.c flash_store.c
 
 
 
@@ -152,6 +152,22 @@ ${OBJECTDIR}/sequence_engine.p1: sequence_engine.c  nbproject/Makefile-${CND_CON
 	@-${MV} ${OBJECTDIR}/sequence_engine.d ${OBJECTDIR}/sequence_engine.p1.d 
 	@${FIXDEPS} ${OBJECTDIR}/sequence_engine.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
 	
+${OBJECTDIR}/flash_store.p1: flash_store.c  nbproject/Makefile-${CND_CONF}.mk 
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash_store.p1.d 
+	@${RM} ${OBJECTDIR}/flash_store.p1 
+	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c  -D__DEBUG=1  -mdebugger=none   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/flash_store.p1 flash_store.c 
+	@-${MV} ${OBJECTDIR}/flash_store.d ${OBJECTDIR}/flash_store.p1.d 
+	@${FIXDEPS} ${OBJECTDIR}/flash_store.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
+	
+${OBJECTDIR}/crc16.p1: crc16.c  nbproject/Makefile-${CND_CONF}.mk 
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/crc16.p1.d 
+	@${RM} ${OBJECTDIR}/crc16.p1 
+	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c  -D__DEBUG=1  -mdebugger=none   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/crc16.p1 crc16.c 
+	@-${MV} ${OBJECTDIR}/crc16.d ${OBJECTDIR}/crc16.p1.d 
+	@${FIXDEPS} ${OBJECTDIR}/crc16.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
+	
 else
 ${OBJECTDIR}/config.p1: config.c  nbproject/Makefile-${CND_CONF}.mk 
 	@${MKDIR} "${OBJECTDIR}" 
@@ -217,6 +233,22 @@ ${OBJECTDIR}/sequence_engine.p1: sequence_engine.c  nbproject/Makefile-${CND_CON
 	@-${MV} ${OBJECTDIR}/sequence_engine.d ${OBJECTDIR}/sequence_engine.p1.d 
 	@${FIXDEPS} ${OBJECTDIR}/sequence_engine.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
 	
+${OBJECTDIR}/flash_store.p1: flash_store.c  nbproject/Makefile-${CND_CONF}.mk 
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash_store.p1.d 
+	@${RM} ${OBJECTDIR}/flash_store.p1 
+	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/flash_store.p1 flash_store.c 
+	@-${MV} ${OBJECTDIR}/flash_store.d ${OBJECTDIR}/flash_store.p1.d 
+	@${FIXDEPS} ${OBJECTDIR}/flash_store.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
+	
+${OBJECTDIR}/crc16.p1: crc16.c  nbproject/Makefile-${CND_CONF}.mk 
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/crc16.p1.d 
+	@${RM} ${OBJECTDIR}/crc16.p1 
+	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/crc16.p1 crc16.c 
+	@-${MV} ${OBJECTDIR}/crc16.d ${OBJECTDIR}/crc16.p1.d 
+	@${FIXDEPS} ${OBJECTDIR}/crc16.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
+	
 endif
 
 # ------------------------------------------------------------------------------------
@@ -236,14 +268,14 @@ endif
 ifeq ($(TYPE_IMAGE), DEBUG_RUN)
 ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.${OUTPUT_SUFFIX}: ${OBJECTFILES}  nbproject/Makefile-${CND_CONF}.mk    
 	@${MKDIR} ${DISTDIR} 
-	${MP_CC} $(MP_EXTRA_LD_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -Wl,-Map=${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.map  -D__DEBUG=1  -mdebugger=none  -DXPRJ_default=$(CND_CONF)  -Wl,--defsym=__MPLAB_BUILD=1   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto        $(COMPARISON_BUILD) -Wl,--memorysummary,${DISTDIR}/memoryfile.xml -o ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX}  ${OBJECTFILES_QUOTED_IF_SPACED}     
+	${MP_CC} $(MP_EXTRA_LD_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -Wl,-Map=${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.map  -mrom=default,-1C000-1FFFF -D__DEBUG=1  -mdebugger=none  -DXPRJ_default=$(CND_CONF)  -Wl,--defsym=__MPLAB_BUILD=1   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto        $(COMPARISON_BUILD) -Wl,--memorysummary,${DISTDIR}/memoryfile.xml -o ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX}  ${OBJECTFILES_QUOTED_IF_SPACED}     
 	@${RM} ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.hex 
 	
 	
 else
 ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.${OUTPUT_SUFFIX}: ${OBJECTFILES}  nbproject/Makefile-${CND_CONF}.mk   
 	@${MKDIR} ${DISTDIR} 
-	${MP_CC} $(MP_EXTRA_LD_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -Wl,-Map=${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.map  -DXPRJ_default=$(CND_CONF)  -Wl,--defsym=__MPLAB_BUILD=1   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     $(COMPARISON_BUILD) -Wl,--memorysummary,${DISTDIR}/memoryfile.xml -o ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX}  ${OBJECTFILES_QUOTED_IF_SPACED}     
+	${MP_CC} $(MP_EXTRA_LD_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -Wl,-Map=${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.map  -mrom=default,-1C000-1FFFF -DXPRJ_default=$(CND_CONF)  -Wl,--defsym=__MPLAB_BUILD=1   -mdfp="${DFP_DIR}/xc8"  -fno-short-double -fno-short-float -memi=wordwrite -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -mwarn=-3 -Wa,-a -msummary=-psect,-class,+mem,-hex,-file  -ginhx32 -Wl,--data-init -mno-keep-startup -mno-download -mno-default-config-bits -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     $(COMPARISON_BUILD) -Wl,--memorysummary,${DISTDIR}/memoryfile.xml -o ${DISTDIR}/LC4_firmware.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX}  ${OBJECTFILES_QUOTED_IF_SPACED}     
 	
 	
 endif
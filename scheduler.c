@@ -10,15 +10,23 @@
 // --- Variables Globales y Estticas ---
 volatile bool g_rtc_access_in_progress = false;
 
-static Plan g_plan_cache[MAX_PLANS];
+static Plan g_plan_cache[MAX_PLANS_TOTAL];
+// Calendario de feriados: un bit por da del ao (calendario de 366 das, el
+// 29 de febrero siempre ocupa su posicin). Se decodifica al recargar el cach.
+static uint8_t g_holiday_bitmap[(366 + 7) / 8];
 // Esta variable ahora representa el plan que el scheduler *ha solicitado*.
 // No es necesariamente el que est corriendo en el motor.
 static int8_t g_requested_plan_index = -1;
+// Tras confirmar una transaccin hay que volver a solicitar el plan aunque el
+// ndice no cambie, o detener el motor si ya no aplica ninguno.
+static bool g_force_plan_request = false;
 
 // --- Prototipos de Funciones Internas ---
 static bool Scheduler_IsDateHoliday(RTC_Time* date);
 static bool IsPlanValidForDay(uint8_t id_tipo_dia, uint8_t dayOfWeek, bool is_holiday);
 static void Scheduler_LoadPlansToCache(void);
+static void Scheduler_LoadHolidaysToCache(void);
+static uint16_t Scheduler_DayOfYear(uint8_t day, uint8_t month);
 static void Scheduler_UpdateAndExecutePlan(void);
 static void Scheduler_GetYesterdayContext(RTC_Time* today, uint8_t* yesterday_dow, bool* is_yesterday_holiday);
 static bool IsLeapYear(uint8_t year_yy);
@@ -28,16 +36,28 @@ static bool IsLeapYear(uint8_t year_yy);
 //==============================================================================
 void Scheduler_Init(void) {
     Scheduler_LoadPlansToCache();
+    Scheduler_LoadHolidaysToCache();
     // La primera evaluacin de plan se hace aqu para arrancar con el plan correcto
     Scheduler_UpdateAndExecutePlan();
 }
 
 void Scheduler_ReloadCache(void) {
     Scheduler_LoadPlansToCache();
+    Scheduler_LoadHolidaysToCache();
+}
+
+void Scheduler_ApplyCommittedConfig(void) {
+    Scheduler_LoadPlansToCache();
+    Scheduler_LoadHolidaysToCache();
+    // Forzar una nueva solicitud aunque el ndice de plan no cambie: el motor
+    // la aplica en su prximo punto de transicin, como cualquier cambio de plan.
+    g_force_plan_request = true;
+    Scheduler_UpdateAndExecutePlan();
 }
 
 void Scheduler_Task(void) {
     if (g_rtc_access_in_progress) return;
+    if (EEPROM_IsTransactionOpen()) return; // Configuracin a medio cargar
     RTC_Time now;
     g_rtc_access_in_progress = true;
     RTC_GetTime(&now);
@@ -55,9 +75,12 @@ void Scheduler_Task(void) {
 // --- IMPLEMENTACIN DE LA LGICA DE PLANIFICACIN ---
 //==============================================================================
 static void Scheduler_LoadPlansToCache(void) {
-    for (uint8_t i = 0; i < MAX_PLANS; i++) {
-        EEPROM_ReadPlan(i, &g_plan_cache[i].id_tipo_dia, &g_plan_cache[i].id_secuencia,
-                        &g_plan_cache[i].time_sel, &g_plan_cache[i].hour, &g_plan_cache[i].minute);
+    for (uint8_t i = 0; i < MAX_PLANS_TOTAL; i++) {
+        EEPROM_ReadPlan(i, &g_plan_cache[i]);
+        // Con la imagen corrupta (CRC) no se ejecuta ningn plan: el motor queda en fallback.
+        if (!EEPROM_IsImageValid()) {
+            g_plan_cache[i].id_tipo_dia = 0xFF;
+        }
     }
 }
 
@@ -88,15 +111,37 @@ static void Scheduler_GetYesterdayContext(RTC_Time* today, uint8_t* yesterday_do
     *is_yesterday_holiday = Scheduler_IsDateHoliday(&yesterday);
 }
 
-static bool Scheduler_IsDateHoliday(RTC_Time* date) {
+/**
+ * @brief Posicin (0..365) de una fecha en el calendario de 366 das.
+ * @details Febrero admite siempre el 29: un feriado guardado en esa fecha
+ * solo coincide en aos bisiestos.
+ * @return 0xFFFF si la fecha no es vlida.
+ */
+static uint16_t Scheduler_DayOfYear(uint8_t day, uint8_t month) {
+    static const uint16_t first_day_of_month[13] = {0, 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335};
+    static const uint8_t days_in_month[13] = {0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month < 1 || month > 12 || day < 1 || day > days_in_month[month]) return 0xFFFF;
+    return first_day_of_month[month] + day - 1;
+}
+
+static void Scheduler_LoadHolidaysToCache(void) {
+    for (uint8_t i = 0; i < sizeof(g_holiday_bitmap); i++) {
+        g_holiday_bitmap[i] = 0;
+    }
     for (uint8_t i = 0; i < MAX_HOLIDAYS; i++) {
         uint8_t f_day, f_month;
         EEPROM_ReadHoliday(i, &f_day, &f_month);
-        if (f_day != 0xFF && f_day == date->day && f_month == date->month) {
-            return true;
+        uint16_t doy = Scheduler_DayOfYear(f_day, f_month);
+        if (doy != 0xFFFF) {
+            g_holiday_bitmap[doy >> 3] |= (uint8_t)(1 << (doy & 7));
         }
     }
-    return false;
+}
+
+static bool Scheduler_IsDateHoliday(RTC_Time* date) {
+    uint16_t doy = Scheduler_DayOfYear(date->day, date->month);
+    if (doy == 0xFFFF) return false;
+    return (g_holiday_bitmap[doy >> 3] & (1 << (doy & 7))) != 0;
 }
 
 static bool IsPlanValidForDay(uint8_t id_tipo_dia, uint8_t dayOfWeek, bool is_holiday) {
@@ -145,7 +190,7 @@ static void Scheduler_UpdateAndExecutePlan(void) {
     uint16_t time_of_best_candidate_yesterday = 0;
     bool any_plan_exists = false;
 
-    for (uint8_t i = 0; i < MAX_PLANS; i++) {
+    for (uint8_t i = 0; i < MAX_PLANS_TOTAL; i++) {
         Plan* p = &g_plan_cache[i];
         if (p->id_tipo_dia > 14) continue;
         any_plan_exists = true;
@@ -178,7 +223,7 @@ static void Scheduler_UpdateAndExecutePlan(void) {
     // --- LGICA DE EJECUCIN MODIFICADA ---
     if (new_plan_index != -1) {
         // El plan que DEBERA estar activo es diferente al que solicitamos la ltima vez?
-        if (new_plan_index != g_requested_plan_index) {
+        if (new_plan_index != g_requested_plan_index || g_force_plan_request) {
             g_requested_plan_index = new_plan_index;
             Plan* active_plan = &g_plan_cache[g_requested_plan_index];
             
@@ -192,15 +237,16 @@ static void Scheduler_UpdateAndExecutePlan(void) {
         }
     } else if (any_plan_exists) {
         // Hay planes pero ninguno aplica. Detener el motor.
-        if (g_requested_plan_index != -1) {
+        if (g_requested_plan_index != -1 || g_force_plan_request) {
              g_requested_plan_index = -1;
              Sequence_Engine_Stop();
         }
     } else {
         // No hay ningn plan en la EEPROM. Entrar en modo Fallback.
-        if (g_requested_plan_index != -1) {
+        if (g_requested_plan_index != -1 || g_force_plan_request) {
             g_requested_plan_index = -1;
             Sequence_Engine_EnterFallback();
         }
     }
+    g_force_plan_request = false;
 }
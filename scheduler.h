@@ -25,21 +25,22 @@ void Demands_ClearAll(void);
 // Bandera para controlar el acceso al RTC
 extern volatile bool g_rtc_access_in_progress;
 
-// Estructura para el cach de planes en RAM
-typedef struct {
-    uint8_t id_tipo_dia;
-    uint8_t id_secuencia;
-    uint8_t time_sel;
-    uint8_t hour;
-    uint8_t minute;
-} Plan;
+// El cach de planes en RAM usa la estructura Plan de eeprom.h
 
 void Scheduler_Init(void);
 void Scheduler_Task(void);
 
 /**
- * @brief Fuerza al scheduler a recargar el cach de planes desde la EEPROM.
+ * @brief Fuerza al scheduler a recargar el cach de planes y el calendario de
+ * feriados desde la EEPROM.
  */
 void Scheduler_ReloadCache(void);
 
+/**
+ * @brief Recarga el cach tras confirmar una transaccin de configuracin y
+ * vuelve a solicitar el plan vigente para que el motor lo arranque con la
+ * configuracin nueva en su prximo punto de transicin.
+ */
+void Scheduler_ApplyCommittedConfig(void);
+
 #endif // SCHEDULER_H
@@ -35,22 +35,39 @@ static EngineState_t engine_state;
 static uint8_t current_time_selector;
 static uint16_t movement_countdown_s;
 static uint8_t active_sequence_id;
-static uint8_t active_sequence_type;
-static uint8_t active_sequence_anchor_mov;
-
-static struct {
-    uint8_t num_movements;
-    uint8_t movement_indices[12];
-} active_sequence;
+static Sequence active_sequence;   // Tipo, POSICIN del ancla e ndices de la secuencia activa
 static uint8_t active_sequence_step;
 
-static bool blink_phase_on = false;
-static struct {
+typedef struct {
     bool active;
     uint8_t mask_d;
     uint8_t mask_e;
     uint8_t mask_f;
-} active_intermittence_rule;
+} IntermittenceRule_t;
+
+static bool blink_phase_on = false;
+static IntermittenceRule_t active_intermittence_rule;
+
+// --- TABLA DE PASOS COMPILADA ---
+// Sequence_Engine_Start() resuelve la secuencia activa UNA sola vez: puertos,
+// duracin segn current_time_selector, intermitencia del plan y sucesor.
+// En cada fin de movimiento solo se indexa esta tabla (sin accesos a EEPROM).
+// Tambin hace de cach en RAM para las secuencias largas guardadas en flash.
+typedef struct {
+    uint8_t mov_index;              // ndice del movimiento (para validacin)
+    uint8_t ports[5];               // D, E, F, H, J
+    uint8_t duration_s;             // Tiempo ya resuelto con el selector activo
+    IntermittenceRule_t intermittence;
+    uint8_t jump[16];               // Sucesor indexado por la instantnea de demandas (P1..P4)
+    uint16_t consumes_mask;         // Bit d: en la combinacin d decidi una regla condicional
+} CompiledStep_t;
+
+static CompiledStep_t step_table[MAX_SEQUENCE_STEPS];
+static bool step_table_stale = false;
+
+// Reglas de flujo de la secuencia activa, en orden de prioridad (solo durante la compilacin)
+static FlowRule flow_rules[MAX_FLOW_CONTROL_RULES];
+static uint8_t num_flow_rules;
 
 static uint8_t current_mov_ports[5];
 static uint8_t manual_flash_ports[5];
@@ -61,11 +78,25 @@ static uint8_t pending_time_sel;
 static int8_t pending_plan_id;
 static int8_t running_plan_id = -1;
 
-static uint8_t active_sequence_anchor_step;
+// --- ESTADO ANOTADO EN EL LOG DE LA EEPROM ---
+// Se anota de inmediato al cambiar de plan o al caer a fallback por datos
+// invlidos y, sin eventos, en un fin de movimiento cada hora.
+// Desgaste: 24 anotaciones peridicas + ~24 cambios de plan al da (horario
+// muy cargado) = ~48 grabaciones/da repartidas en 5 ranuras, ~10 por celda
+// y da, ~3500 al ao. Con 100K ciclos de la EEPROM del PIC18F8720 da ~28
+// aos, por encima de los 20 de vida prevista del controlador.
+#define RUNTIME_CHECKPOINT_INTERVAL_S 3600
+static RuntimeState runtime_state;
+static uint16_t checkpoint_elapsed_s = 0;
+static bool checkpoint_pending = false;
 
 // Prototipos de funciones internas
 static void apply_light_outputs(void);
 static void Safe_Delay_ms(uint16_t ms);
+static bool compile_active_sequence(void);
+static void compile_flow_rules(CompiledStep_t *cs, uint8_t step);
+static uint8_t read_demand_snapshot(void);
+static void enter_fault_fallback(void);
 
 
 static void Safe_Delay_ms(uint16_t ms) {
@@ -77,12 +108,12 @@ static void Safe_Delay_ms(uint16_t ms) {
 
 void Sequence_Engine_RunStartupSequence(void) {
     uint8_t i;
-    uint8_t mov0_ports[5];
-    uint8_t mov0_times[5];
+    Movement mov0;
+    uint8_t *mov0_ports = mov0.ports;
     
-    EEPROM_ReadMovement(0, &mov0_ports[0], &mov0_ports[1], &mov0_ports[2], &mov0_ports[3], &mov0_ports[4], mov0_times);
+    EEPROM_ReadMovement(0, &mov0);
 
-    if (!EEPROM_IsMovementValid(mov0_ports[0], mov0_ports[1], mov0_ports[2], mov0_ports[3], mov0_ports[4], mov0_times)) {
+    if (!EEPROM_IsMovementValid(&mov0)) {
         mov0_ports[0] = ALL_RED_MASK_D;
         mov0_ports[1] = ALL_RED_MASK_E;
         mov0_ports[2] = ALL_RED_MASK_F;
@@ -113,6 +144,16 @@ void Sequence_Engine_RunStartupSequence(void) {
 }
 
 void Sequence_Engine_Init(void) {
+    // Los contadores continan desde la ltima anotacin del log.
+    if (!EEPROM_LogLoad(&runtime_state)) {
+        runtime_state.plan_id = -1;
+        runtime_state.step = 0;
+        runtime_state.cycles = 0;
+        runtime_state.faults = 0;
+    }
+    checkpoint_elapsed_s = 0;
+    checkpoint_pending = false;
+
     engine_state = STATE_FALLBACK_MODE;
     active_sequence_step = 0;
     movement_countdown_s = 0;
@@ -125,31 +166,26 @@ void Sequence_Engine_Init(void) {
 void Sequence_Engine_EnterManualFlash(void) {
     engine_state = STATE_MANUAL_FLASH;
     running_plan_id = -1;
-    uint8_t dummy_times[5];
-    EEPROM_ReadMovement(0, &manual_flash_ports[0], &manual_flash_ports[1], &manual_flash_ports[2], &manual_flash_ports[3], &manual_flash_ports[4], dummy_times);
+    Movement mov0;
+    EEPROM_ReadMovement(0, &mov0);
+    for (uint8_t i = 0; i < 5; i++) manual_flash_ports[i] = mov0.ports[i];
 }
 
 void Sequence_Engine_Start(uint8_t sec_index, uint8_t time_sel, int8_t plan_id) {
     plan_change_pending = false;
     running_plan_id = plan_id;
+    checkpoint_pending = true; // Anotar el nuevo plan en el primer paso
 
-    if (sec_index >= MAX_SEQUENCES) {
+    if (sec_index >= MAX_SEQUENCES_TOTAL) {
         engine_state = STATE_FALLBACK_MODE;
         return;
     }
 
     active_sequence_id = sec_index;
+    current_time_selector = time_sel;
 
-    // Leemos todos los datos de la secuencia, incluyendo la POSICIN del ancla
-    EEPROM_ReadSequence(sec_index,
-                        &active_sequence_type,
-                        &active_sequence_anchor_step, // Se guarda la POSICIN del ancla
-                        &active_sequence.num_movements,
-                        active_sequence.movement_indices);
-
-    if (active_sequence.num_movements > 0 && active_sequence.num_movements <= 12) {
+    if (compile_active_sequence()) {
         engine_state = STATE_RUNNING_SEQUENCE;
-        current_time_selector = time_sel;
         active_sequence_step = 0;
         movement_countdown_s = 0;
         active_intermittence_rule.active = false;
@@ -158,6 +194,144 @@ void Sequence_Engine_Start(uint8_t sec_index, uint8_t time_sel, int8_t plan_id)
     }
 }
 
+/**
+ * @brief Compila la secuencia activa en step_table leyendo la EEPROM una sola vez.
+ * @return false si la secuencia no tiene movimientos (el motor debe ir a fallback).
+ */
+static bool compile_active_sequence(void) {
+    step_table_stale = false;
+
+    // Leemos todos los datos de la secuencia, incluyendo la POSICIN del ancla
+    EEPROM_ReadSequence(active_sequence_id, &active_sequence);
+
+    if (active_sequence.num_movements == 0) {
+        return false;
+    }
+
+    // Reglas de flujo: solo aplican a secuencias BAJO DEMANDA.
+    num_flow_rules = 0;
+    if (active_sequence.type == SEQUENCE_TYPE_DEMAND) {
+        for (uint8_t i = 0; i < MAX_FLOW_CONTROL_RULES; i++) {
+            FlowRule *r = &flow_rules[num_flow_rules];
+            EEPROM_ReadFlowRule(i, r);
+            if (r->sec_index == active_sequence_id) {
+                num_flow_rules++;
+            }
+        }
+    }
+
+    for (uint8_t step = 0; step < active_sequence.num_movements; step++) {
+        CompiledStep_t *cs = &step_table[step];
+        uint8_t mov_idx = active_sequence.movement_indices[step];
+        CLRWDT();
+
+        cs->mov_index = mov_idx;
+        cs->intermittence.active = false;
+        compile_flow_rules(cs, step);
+        if (mov_idx >= MAX_MOVEMENTS_TOTAL) {
+            continue; // Se detecta al llegar a este paso (fallback)
+        }
+
+        // Puertos y duracin resuelta con el selector de tiempo activo
+        Movement mov;
+        EEPROM_ReadMovement(mov_idx, &mov);
+        for (uint8_t i = 0; i < 5; i++) cs->ports[i] = mov.ports[i];
+        cs->duration_s = (current_time_selector < 5) ? mov.times[current_time_selector] : 1;
+        if (cs->duration_s == 0) cs->duration_s = 1;
+
+        // Lgica de intermitencia (depende del plan en ejecucin)
+        if (running_plan_id != -1) {
+            for (uint8_t i = 0; i < MAX_INTERMITENCES; i++) {
+                uint8_t p_id, m_id, mD, mE, mF;
+                EEPROM_ReadIntermittence(i, &p_id, &m_id, &mD, &mE, &mF);
+                if (p_id == (uint8_t)running_plan_id && m_id == mov_idx) {
+                    cs->intermittence.active = true;
+                    cs->intermittence.mask_d = mD;
+                    cs->intermittence.mask_e = mE;
+                    cs->intermittence.mask_f = mF;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Resuelve las reglas de flujo de un paso en su tabla de saltos.
+ * @details Para cada una de las 16 combinaciones de demandas se recorren las
+ * reglas del movimiento de origen en orden de prioridad; gana la primera cuya
+ * condicin se cumple. Sin regla aplicable, el sucesor es el paso siguiente.
+ * Un registro antiguo (accin RULE_ACTION_LEGACY) conserva la semntica
+ * original: la primera regla del origen decide sola y, si su condicin no se
+ * cumple o su destino no es vlido, no se consultan las siguientes.
+ * consumes_mask marca las combinaciones cuyo sucesor decidi una regla
+ * condicional: solo en ellas se limpian las demandas al avanzar.
+ */
+static void compile_flow_rules(CompiledStep_t *cs, uint8_t step) {
+    uint8_t n = active_sequence.num_movements;
+    uint8_t sequential = (uint8_t)((step + 1) % n);
+
+    cs->consumes_mask = 0;
+    for (uint8_t demands = 0; demands < 16; demands++) {
+        uint8_t next = sequential;
+        bool consumed = false;
+        for (uint8_t i = 0; i < num_flow_rules; i++) {
+            const FlowRule *r = &flow_rules[i];
+            if (r->origin_mov != cs->mov_index) continue;
+            bool legacy = (r->action == RULE_ACTION_LEGACY);
+
+            bool condition_met;
+            uint8_t masked = demands & r->mask & 0x0F;
+            switch (r->type) {
+                case RULE_TYPE_GOTO:          condition_met = true; break;
+                case RULE_TYPE_DECISION_ANY:  condition_met = (masked != 0); break;
+                case RULE_TYPE_DECISION_ALL:  condition_met = (masked == (r->mask & 0x0F)); break;
+                case RULE_TYPE_DECISION_NONE: condition_met = (masked == 0); break;
+                default: condition_met = false; break;
+            }
+            bool decision = (r->type == RULE_TYPE_DECISION_ANY || r->type == RULE_TYPE_DECISION_ALL ||
+                             r->type == RULE_TYPE_DECISION_NONE);
+
+            // Destino: posicin absoluta o N pasos a saltar. Se ignoran destinos fuera de la secuencia.
+            bool dest_ok = true;
+            uint8_t dest = sequential;
+            if (r->action == RULE_ACTION_SKIP_STEPS) {
+                dest = (uint8_t)((sequential + r->dest) % n);
+            } else if ((r->action == RULE_ACTION_GOTO_STEP || legacy) && r->dest < n) {
+                dest = r->dest;
+            } else {
+                dest_ok = false;
+            }
+
+            if (condition_met && dest_ok) {
+                next = dest;
+                consumed = decision;
+                break;
+            }
+            if (legacy) {
+                consumed = decision; // El punto de decisin se evalu aunque no se cumpliera
+                break;               // Primera coincidencia, como en el formato original
+            }
+        }
+        cs->jump[demands] = next;
+        if (consumed) cs->consumes_mask |= (uint16_t)(1u << demands);
+    }
+}
+
+static uint8_t read_demand_snapshot(void) {
+    uint8_t snapshot = 0;
+    for (uint8_t j = 0; j < 4; j++) {
+        if (g_demand_flags[j]) snapshot |= (uint8_t)(1 << j);
+    }
+    return snapshot;
+}
+
+void Sequence_Engine_ReloadStepTable(void) {
+    // Se recompila en el prximo fin de movimiento, no en medio de uno.
+    step_table_stale = true;
+}
+
 void Sequence_Engine_RequestPlanChange(uint8_t sec_index, uint8_t time_sel, int8_t new_plan_id) {
     plan_change_pending = true;
     pending_sec_index = sec_index;
@@ -180,6 +354,29 @@ void Sequence_Engine_EnterFallback(void) {
     running_plan_id = -1;
 }
 
+// Fallback forzado por una secuencia o movimiento invlido: se cuenta como fallo.
+static void enter_fault_fallback(void) {
+    engine_state = STATE_FALLBACK_MODE;
+    runtime_state.faults++;
+    runtime_state.plan_id = running_plan_id;
+    runtime_state.step = active_sequence_step;
+    EEPROM_LogAppend(&runtime_state);
+    checkpoint_elapsed_s = 0;
+}
+
+void Sequence_Engine_GetRuntimeState(RuntimeState *state) {
+    *state = runtime_state;
+}
+
+void Sequence_Engine_GetTelemetry(EngineTelemetry *telemetry) {
+    telemetry->step = active_sequence_step;
+    telemetry->countdown_s = movement_countdown_s;
+    telemetry->plan_id = running_plan_id;
+    telemetry->demands = read_demand_snapshot();
+    telemetry->flags = (uint8_t)((uint8_t)engine_state & TELEMETRY_FLAG_STATE_MASK);
+    if (blink_phase_on) telemetry->flags |= TELEMETRY_FLAG_BLINK_ON;
+}
+
 void Sequence_Engine_Run(bool half_second_tick, bool one_second_tick) {
     if (half_second_tick) {
         blink_phase_on = !blink_phase_on;
@@ -190,6 +387,9 @@ void Sequence_Engine_Run(bool half_second_tick, bool one_second_tick) {
             if (one_second_tick && movement_countdown_s > 0) {
                 movement_countdown_s--;
             }
+            if (one_second_tick && checkpoint_elapsed_s < RUNTIME_CHECKPOINT_INTERVAL_S) {
+                checkpoint_elapsed_s++;
+            }
 
             if (movement_countdown_s == 0) {
                 
@@ -197,22 +397,44 @@ void Sequence_Engine_Run(bool half_second_tick, bool one_second_tick) {
                 // <<< INICIO DE LA LGICA CORREGIDA >>>
                 // =================================================================
 
-                // PASO 1: Cargar y configurar el MOVIMIENTO ACTUAL.
+                // PASO 1: Cargar y configurar el MOVIMIENTO ACTUAL desde la tabla compilada.
                 // Esta lgica se ejecuta primero para asegurar que la secuencia siempre inicie.
+                // Con una transaccin abierta o un cambio de plan pendiente se
+                // sigue con la tabla actual; el cambio entra en el lmite de ciclo.
+                if (step_table_stale && !plan_change_pending && !EEPROM_IsTransactionOpen()) {
+                    if (!compile_active_sequence()) {
+                        enter_fault_fallback();
+                        break;
+                    }
+                    if (active_sequence_step >= active_sequence.num_movements) {
+                        active_sequence_step = 0;
+                    }
+                }
                 if (active_sequence.num_movements == 0) {
-                    engine_state = STATE_FALLBACK_MODE;
+                    enter_fault_fallback();
                     break;
                 }
-                uint8_t mov_idx_to_run = active_sequence.movement_indices[active_sequence_step];
-                if (mov_idx_to_run >= MAX_MOVEMENTS) {
-                    engine_state = STATE_FALLBACK_MODE;
+                const CompiledStep_t *cs = &step_table[active_sequence_step];
+                if (cs->mov_index >= MAX_MOVEMENTS_TOTAL) {
+                    enter_fault_fallback();
                     break;
                 }
 
-                uint8_t times[5];
-                EEPROM_ReadMovement(mov_idx_to_run, &current_mov_ports[0], &current_mov_ports[1], &current_mov_ports[2], &current_mov_ports[3], &current_mov_ports[4], times);
-                movement_countdown_s = (current_time_selector < 5) ? times[current_time_selector] : 1;
-                if (movement_countdown_s == 0) movement_countdown_s = 1;
+                for (uint8_t i = 0; i < 5; i++) current_mov_ports[i] = cs->ports[i];
+                movement_countdown_s = cs->duration_s;
+                active_intermittence_rule = cs->intermittence;
+
+                // Anotacin peridica del estado en el log de la EEPROM.
+                if (active_sequence_step == 0) {
+                    runtime_state.cycles++;
+                }
+                runtime_state.plan_id = running_plan_id;
+                runtime_state.step = active_sequence_step;
+                if (checkpoint_pending || checkpoint_elapsed_s >= RUNTIME_CHECKPOINT_INTERVAL_S) {
+                    EEPROM_LogAppend(&runtime_state);
+                    checkpoint_pending = false;
+                    checkpoint_elapsed_s = 0;
+                }
                 
                 // Si el monitoreo est activo, enviar el reporte de estado AHORA.
                 if (g_monitoring_active) {
@@ -223,71 +445,28 @@ void Sequence_Engine_Run(bool half_second_tick, bool one_second_tick) {
                                                 current_mov_ports[4]);
                 }
                 
-                // Lgica de intermitencia
-                active_intermittence_rule.active = false;
-                if (running_plan_id != -1) {
-                    for (uint8_t i = 0; i < MAX_INTERMITENCES; i++) {
-                        CLRWDT();
-                        uint8_t p_id, m_id, mD, mE, mF;
-                        EEPROM_ReadIntermittence(i, &p_id, &m_id, &mD, &mE, &mF);
-                        if (p_id == (uint8_t)running_plan_id && m_id == mov_idx_to_run) {
-                            active_intermittence_rule.active = true;
-                            active_intermittence_rule.mask_d = mD;
-                            active_intermittence_rule.mask_e = mE;
-                            active_intermittence_rule.mask_f = mF;
-                            break;
-                        }
-                    }
-                }
-                
-                // PASO 2: Calcular el NDICE DEL SIGUIENTE PASO.
-                uint8_t next_step_index = (active_sequence_step + 1) % active_sequence.num_movements;
-
-                // PASO 3: Procesar reglas de flujo si la secuencia es BAJO DEMANDA.
-                if (active_sequence_type == SEQUENCE_TYPE_DEMAND) {
-                    bool decision_point_was_evaluated = false;
-                    for (uint8_t i = 0; i < MAX_FLOW_CONTROL_RULES; i++) {
-                        CLRWDT();
-                        uint8_t r_sec, r_orig, r_type, r_mask, r_dest;
-                        EEPROM_ReadFlowRule(i, &r_sec, &r_orig, &r_type, &r_mask, &r_dest);
-
-                        if (r_sec == active_sequence_id && r_orig == mov_idx_to_run) {
-                            if (r_type == RULE_TYPE_GOTO) {
-                                next_step_index = r_dest;
-                            } else if (r_type == RULE_TYPE_DECISION_POINT) {
-                                decision_point_was_evaluated = true;
-                                bool condition_met = false;
-                                for(uint8_t j = 0; j < 4; j++) {
-                                    if ((r_mask & (1 << j)) && (g_demand_flags[j] == true)) {
-                                        condition_met = true;
-                                        break;
-                                    }
-                                }
-                                if (condition_met) {
-                                    next_step_index = r_dest;
-                                }
-                            }
-                            break;
-                        }
-                    }
-                    if (decision_point_was_evaluated) {
-                        Demands_ClearAll();
-                    }
+                // PASO 2 y 3: Sucesor = una sola consulta a la tabla de saltos
+                // con la instantnea de demandas (reglas de flujo ya compiladas).
+                // Las demandas se consumen solo si el sucesor lo eligi una regla condicional.
+                uint8_t demand_snapshot = read_demand_snapshot();
+                uint8_t next_step_index = cs->jump[demand_snapshot];
+                if (cs->consumes_mask & (uint16_t)(1u << demand_snapshot)) {
+                    Demands_ClearAll();
                 }
 
                 // PASO 4: Lgica de Transicin de Plan.
                 bool can_transition = false;
-                if (plan_change_pending) {
-                    if (active_sequence_type == SEQUENCE_TYPE_AUTOMATIC) {
+                if (plan_change_pending && !EEPROM_IsTransactionOpen()) {
+                    if (active_sequence.type == SEQUENCE_TYPE_AUTOMATIC) {
                         // Transicin si el paso que va a empezar es el primero (el ciclo termin).
                         if (active_sequence_step == 0) {
                             can_transition = true;
                         }
                     } 
-                    else if (active_sequence_type == SEQUENCE_TYPE_DEMAND) {
+                    else if (active_sequence.type == SEQUENCE_TYPE_DEMAND) {
                         // Transicin si el paso que acaba de terminar era el paso ancla.
                         // Comparamos POSICIN con POSICIN.
-                        if (active_sequence_step == active_sequence_anchor_step) {
+                        if (active_sequence_step == active_sequence.anchor_step) {
                             can_transition = true;
                         }
                     }
@@ -314,7 +493,7 @@ void Sequence_Engine_Run(bool half_second_tick, bool one_second_tick) {
 
 
         case STATE_FALLBACK_MODE:
-            if (plan_change_pending) {
+            if (plan_change_pending && !EEPROM_IsTransactionOpen()) {
                 Sequence_Engine_Start(pending_sec_index, pending_time_sel, pending_plan_id);
                 break;
             }
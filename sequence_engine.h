@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "eeprom.h" // Para RuntimeState
 
 void Sequence_Engine_Init(void);
 void Sequence_Engine_Start(uint8_t sec_index, uint8_t time_sel, int8_t plan_id);
@@ -20,4 +21,25 @@ void Sequence_Engine_EnterManualFlash(void);
 
 void Sequence_Engine_EnterFallback(void);
 
+// Marca la tabla de pasos compilada como obsoleta tras guardar movimientos,
+// secuencias, intermitencias o reglas de flujo. Se recompila en el prximo
+// fin de movimiento.
+void Sequence_Engine_ReloadStepTable(void);
+
+// Copia el estado de ejecucin (plan, paso, ciclos y fallos) que se anota en el log.
+void Sequence_Engine_GetRuntimeState(RuntimeState *state);
+
+// Instantnea del motor para la telemetra peridica de UART1
+#define TELEMETRY_FLAG_STATE_MASK 0x03 // Estado del motor (0 inactivo, 1 secuencia, 2 fallback, 3 flasheo manual)
+#define TELEMETRY_FLAG_BLINK_ON   0x80 // Fase encendida de la intermitencia
+typedef struct {
+    uint8_t step;           // Paso de la secuencia activa
+    uint16_t countdown_s;   // Segundos restantes del movimiento en curso
+    int8_t plan_id;         // Plan en ejecucin (-1 = ninguno)
+    uint8_t demands;        // Demandas P1..P4 pendientes en los bits 0..3
+    uint8_t flags;          // TELEMETRY_FLAG_*
+} EngineTelemetry;
+
+void Sequence_Engine_GetTelemetry(EngineTelemetry *telemetry);
+
 #endif // SEQUENCE_ENGINE_H
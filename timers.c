@@ -2,6 +2,7 @@
 #include "timers.h"
 #include "config.h"
 #include "uart.h"
+#include "eeprom.h"
 
 // =============================================================================
 // --- REFERENCIAS A FUNCIONES Y VARIABLES GLOBALES EXTERNAS ---
@@ -19,6 +20,8 @@ extern volatile bool g_system_ready;
 // Definicin de las banderas globales para el control de tiempo
 volatile bool g_one_second_flag = false;
 volatile bool g_half_second_flag = false;
+volatile bool g_tenth_second_flag = false;
+static volatile uint16_t ms_ticks = 0;
 
 // Valor de precarga para el Timer1 para que interrumpa cada 1ms con un cristal de 20MHz
 // (20MHz / 4) / 2 (prescaler) = 2,500,000 ticks/seg
@@ -44,6 +47,8 @@ void __interrupt() ISR(void) {
 
         static uint16_t ms_counter = 0;
         ms_counter++;
+        ms_ticks++;
+        UART_RxTimer_ISR();
 
         // Se sondea nicamente el pin P4 (RB3) cada 10ms.
         // La lgica de antirrebote se puede aadir aqu despus.
@@ -54,6 +59,7 @@ void __interrupt() ISR(void) {
         }
 
         // Generacin de banderas de tiempo
+        if (ms_counter % 100 == 0) g_tenth_second_flag = true;
         if (ms_counter % 500 == 0) g_half_second_flag = true;
         if (ms_counter >= 1000) {
             ms_counter = 0;
@@ -80,6 +86,11 @@ void __interrupt() ISR(void) {
         INTCON3bits.INT2IF = 0; // Limpiar bandera
     }
 
+
+    // --- Manejador de Fin de Escritura de EEPROM ---
+    if (PIE2bits.EEIE && PIR2bits.EEIF) {
+        EEPROM_WriteComplete_ISR();
+    }
     
     // --- Manejador de Recepcin UART1 (RX) ---
     if (PIE1bits.RC1IE && PIR1bits.RC1IF) {
@@ -89,6 +100,7 @@ void __interrupt() ISR(void) {
         {
             RCSTA1bits.CREN = 0;
             RCSTA1bits.CREN = 1;
+            UART_RxOverrun_ISR();
         }
 
         // Leer el dato y pasarlo a la tarea de procesamiento de UART
@@ -112,6 +124,7 @@ void __interrupt() ISR(void) {
         {
             RCSTA2bits.CREN = 0;
             RCSTA2bits.CREN = 1;
+            UART2_RxOverrun_ISR();
         }
 
         // Leer el dato y pasarlo a la tarea de procesamiento de UART2
@@ -162,3 +175,11 @@ void Timers_Init(void) {
     // Iniciar el Timer1
     T1CONbits.TMR1ON = 1;
 }
+
+uint16_t Timers_GetMillis(void) {
+    uint8_t gie = INTCONbits.GIE;
+    INTCONbits.GIE = 0;
+    uint16_t ms = ms_ticks;
+    INTCONbits.GIE = gie;
+    return ms;
+}
@@ -13,6 +13,12 @@ extern volatile bool g_one_second_flag;
 // Bandera para el tick de 0.5 segundos (usada por el Sequence Engine)
 extern volatile bool g_half_second_flag;
 
+// Bandera para el tick de 100 ms (telemetra peridica de UART1)
+extern volatile bool g_tenth_second_flag;
+
 void Timers_Init(void);
 
+// Milisegundos desde el arranque (da la vuelta cada ~65 s); para medir duraciones.
+uint16_t Timers_GetMillis(void);
+
 #endif // TIMERS_H
@@ -7,106 +7,421 @@
 #include "rtc.h"
 #include "scheduler.h"
 #include "sequence_engine.h"
+#include "crc16.h"
+#include "timers.h"
 
 // --- Buffers para comunicacin asncrona ---
 #define UART_TX_BUFFER_SIZE 128
+#define UART2_TX_BUFFER_SIZE 64 // Tamao del buffer de envo para UART2
 #define UART_RX_BUFFER_SIZE 64
 
-static volatile uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
-static volatile uint8_t tx_head = 0;
-static volatile uint8_t tx_tail = 0;
+// --- Cola de recepcin de tramas completas (una por UART) ---
+// La ISR llena una ranura mientras el bucle principal procesa otra, as un
+// comando que llega durante un manejador lento (p.ej. un guardado) no se
+// pierde. Solo se descarta una trama si todas las ranuras estn ocupadas.
+#define UART_RX_FRAME_SLOTS 2
+
+// Silencio mximo entre dos bytes de una misma trama. Pasado este tiempo la
+// trama se da por truncada y el receptor vuelve a buscar el STX, as el
+// siguiente comando no se consume como payload. Holgado frente a los huecos
+// de un adaptador USB-serie (tramas partidas en paquetes de 1 ms).
+#define UART_RX_INTERBYTE_TIMEOUT_MS 20
+
+typedef struct {
+    uint8_t frame[UART_RX_FRAME_SLOTS][UART_RX_BUFFER_SIZE]; // CMD, LEN, payload, CHK o CRC
+    uint8_t length[UART_RX_FRAME_SLOTS];
+    uint8_t drain;          // Prxima ranura a procesar (bucle principal)
+    uint8_t ready;          // Ranuras completas pendientes de procesar
+    uint8_t index;          // Bytes recibidos de la trama en curso (ISR)
+    uint8_t stx_counter;
+    bool receiving;
+    bool awaiting_addr;     // STX visto; falta el byte de direccin (modo bus)
+    bool awaiting_seq;      // Falta el nmero de secuencia (modo secuenciado)
+    bool skip_header;       // Trama ajena: faltan CMD y LEN
+    uint16_t skip;          // Bytes de la trama ajena que quedan por descartar
+    uint8_t addr[UART_RX_FRAME_SLOTS]; // Direccin con la que lleg cada trama
+    uint8_t seq[UART_RX_FRAME_SLOTS];  // Nmero de secuencia de cada trama
+    bool valid[UART_RX_FRAME_SLOTS];   // Checksum o CRC correcto (lo decide la ISR)
+    uint8_t sum;            // Suma acumulada de la trama en curso
+    uint16_t crc;           // CRC-16 acumulado de la trama en curso
+    uint16_t dropped;       // Tramas descartadas por cola llena
+    uint8_t idle_ms;        // ms sin bytes con una trama a medias
+    uint16_t errors;        // Tramas truncadas, sin ETX o con desborde del receptor
+} UartRxQueue;
+
+// --- Motor de protocolo comn a UART1 y UART2 ---
+// Cada puerto tiene su anillo TX, su cola RX y una tabla de comandos. El
+// motor valida checksum y longitud, busca el comando en la tabla y llama a
+// su manejador; as aadir un comando es aadir una fila, no otro 'case'.
+typedef struct UartPort UartPort;
 
-static volatile uint8_t uart_rx_buffer[UART_RX_BUFFER_SIZE];
-static volatile uint8_t uart_rx_index = 0;
-static volatile bool g_frame_received = false;
+/**
+ * @brief Manejador de un comando.
+ * @param data Payload de la trama (ya validado contra la longitud de la tabla).
+ */
+typedef void (*UartCmdHandler)(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len);
+
+#define UART_LEN_ANY  0xFF  // Longitud variable: la valida el manejador
+#define UART_CMD_RTC  0x01  // Bloquear el RTC (g_rtc_access_in_progress) durante el manejador
+#define UART_CMD_CFG  0x02  // Escribe tablas de la EEPROM: no se acepta mientras se limpia un borrado de fbrica
+
+// --- Ventana de comandos secuenciados (CMD_SET_SEQ_MODE) ---
+// ltima respuesta ACK/NACK de cada nmero de secuencia, indexada por
+// seq % UART_SEQ_WINDOW. Si el anfitrin retransmite una peticin cuya
+// respuesta se perdi, se reenva la respuesta sin volver a ejecutarla.
+// En modo bus el contador del anfitrin es comn a todos los nodos y cada uno
+// solo ve sus tramas: una entrada puede sobrevivir a una vuelta completa del
+// SEQ. Por eso cada SEQ nuevo borra las entradas fuera de la ventana y la
+// respuesta solo se repite si adems coincide el CRC de CMD, LEN y payload.
+#define UART_SEQ_WINDOW 8
+
+typedef struct {
+    uint8_t seq;
+    uint8_t cmd;
+    uint8_t reply;          // CMD_ACK, CMD_NACK, RESP_JOB_ACCEPTED o 0 (sin respuesta guardada)
+    uint8_t error;          // Cdigo del NACK o id del trabajo aceptado
+    uint16_t check;         // CRC-16 de CMD, LEN y payload de la peticin
+} UartSeqEntry;
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;            // Longitud exacta del payload, o UART_LEN_ANY
+    uint8_t flags;
+    UartCmdHandler handler;
+} UartCommand;
+
+struct UartPort {
+    volatile uint8_t *tx_buffer;
+    uint8_t tx_size;
+    volatile uint8_t tx_head;
+    volatile uint8_t tx_tail;
+    uint8_t tx_reserve_head;    // Escritura de la reserva en curso (an no visible para la ISR)
+    uint16_t tx_overflows;      // Mensajes descartados por falta de espacio
+    volatile UartRxQueue rxq;
+    const UartCommand *commands;
+    uint8_t num_commands;
+    bool reply_errors;          // false: las tramas invlidas se ignoran sin NACK (MMU)
+    uint8_t unit;               // 1 o 2: selecciona el bit de interrupcin TX
+    // Modo bus (RS-485 multipunto): byte de direccin tras el STX
+    bool addressed;
+    uint8_t bus_addr;           // Direccin propia (ID del controlador)
+    uint8_t bus_group;          // Direccin de grupo, UART_ADDR_NONE si no tiene
+    bool mute;                  // Trama de difusin/grupo en curso: no se responde
+    // Modo secuenciado: byte SEQ tras el STX (y la direccin)
+    bool sequenced;
+    uint8_t tx_seq;             // SEQ de la peticin en curso; 0 = trama espontnea
+    UartSeqEntry *seq_cache;    // NULL si el puerto no admite el modo
+    UartSeqEntry *seq_entry;    // Entrada de la peticin en curso, o NULL
+    bool crc_mode;              // true: CRC-16 de 2 bytes en lugar de la suma
+    uint8_t check_confirm_s;    // Plazo para recibir una trama vlida en CRC; 0 = confirmado
+};
 
-// <<< --- NUEVO: Buffers de transmisin y variables para UART2 --- >>>
-#define UART2_TX_BUFFER_SIZE 64 // Tamao del buffer de envo para UART2
+static volatile uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
 static volatile uint8_t uart2_tx_buffer[UART2_TX_BUFFER_SIZE];
-static volatile uint8_t tx2_head = 0;
-static volatile uint8_t tx2_tail = 0;
-// (Variables de RX de UART2 que ya aadimos)
-static volatile uint8_t uart2_rx_buffer[UART_RX_BUFFER_SIZE];
-static volatile uint8_t uart2_rx_index = 0;
-static volatile bool g_uart2_frame_received = false;
-static volatile bool g_uart2_processing_lock = false;
+static UartPort uart1;
+static UartPort uart2;
+static UartSeqEntry uart1_seq_cache[UART_SEQ_WINDOW];
+
+static uint8_t UART_HandleBulkWrite(uint8_t *payload, uint8_t len, uint8_t *failed_index);
+
+// --- Estado del volcado de imagen EEPROM (CMD_DUMP_IMAGE) ---
+#define DUMP_CHUNK_DATA_MAX 48  // Bytes RLE por trama; la trama completa cabe holgada en el anillo TX
+static bool dump_active = false;
+static uint16_t dump_offset = 0;
+static uint8_t dump_seq = 0;
+static uint8_t dump_req_seq = 0;    // SEQ de la peticin 0x1C (modo secuenciado)
+static uint16_t dump_crc = CRC16_INIT;
+
+static void UART_PortInit(UartPort *port, uint8_t unit, volatile uint8_t *tx_buffer, uint8_t tx_size,
+                          const UartCommand *commands, uint8_t num_commands, bool reply_errors);
+static uint8_t UART_PortTxFree(const UartPort *port);
+static bool UART_PortTxReserve(UartPort *port, uint8_t len);
+static void UART_PortTxPut(UartPort *port, uint8_t byte);
+static void UART_PortTxCommit(UartPort *port);
+static void UART_PortTxPutChecked(UartPort *port, uint8_t byte, uint8_t *checksum, uint16_t *crc);
+static uint8_t UART_PortFrameOverhead(const UartPort *port);
+static bool UART_PortSpontaneousAllowed(const UartPort *port);
+static void UART_PortSendEvent(UartPort *port, uint8_t code, uint8_t arg0, uint8_t arg1);
+static bool UART_PortSendFrame(UartPort *port, uint8_t cmd, uint8_t *payload, uint8_t len);
+static void UART_PortAck(UartPort *port, uint8_t cmd);
+static void UART_PortNack(UartPort *port, uint8_t cmd, uint8_t error_code);
+static void UART_PortNackIndex(UartPort *port, uint8_t cmd, uint8_t error_code, uint8_t index);
+static void UART_PortTask(UartPort *port);
+static void UART_PortDispatch(UartPort *port, uint8_t *buffer, bool valid);
+static void UART_PortReplyRecord(UartPort *port, uint8_t cmd, uint8_t reply, uint8_t error);
+static void UART_SeqCacheExpire(UartPort *port);
+static void UART_DumpService(void);
+
+static void UART_RxQueueByte(UartPort *port, uint8_t byte);
+static void UART_RxFrameStart(UartPort *port);
+static void UART_RxCheckAdd(UartPort *port, uint8_t byte);
+static void UART_RxQueueAbort(volatile UartRxQueue *q);
+static void UART_RxQueueTick(volatile UartRxQueue *q);
+static void UART_BusReload(void);
+static void UART_RxQueueRelease(volatile UartRxQueue *q);
+
+// --- Velocidad de UART1 (negociable con CMD_SET_BAUD / CMD_CONFIRM_BAUD) ---
+#define UART_BAUD_MAX_ERROR_PCT      3
+#define UART_BAUD_CONFIRM_TIMEOUT_S  3
+static const uint32_t uart_baud_rates[] = {9600, 19200, 38400, 57600, 115200};
+static uint32_t uart1_baud = UART_DEFAULT_BAUD;
+static uint32_t baud_previous = UART_DEFAULT_BAUD;
+static uint32_t baud_pending = 0;           // Se aplica al terminar de enviar el ACK
+static uint8_t baud_confirm_timer_s = 0;    // 0 = sin cambio por confirmar
+
+static bool UART_ComputeBaud(uint32_t baudrate, uint8_t *spbrg, bool *brgh);
+static void UART_BaudService(void);
+
+// --- Verificacin de trama (CMD_SET_FRAME_CHECK) ---
+// Tras pasar a CRC, si no llega ninguna trama vlida en el plazo se vuelve a
+// la suma: un ACK perdido no deja al anfitrin y al controlador desacordados.
+#define UART_CHECK_CONFIRM_TIMEOUT_S 3
+static void UART_PortCheckTick(UartPort *port);
+
+// --- Telemetra peridica (CMD_SET_TELEMETRY) ---
+#define TELEMETRY_FIELDS          6     // paso, cuenta H, cuenta L, plan, demandas, banderas
+#define TELEMETRY_MAX_PERIOD      10    // en dcimas de segundo (1 s)
+#define TELEMETRY_KEYFRAME_TICKS  100   // trama completa cada 10 s
+static uint8_t telemetry_period = 0;    // 0 = desactivada
+static uint8_t telemetry_countdown = 0;
+static uint8_t telemetry_keyframe_countdown = 0; // 0 = la prxima trama es completa
+static uint8_t telemetry_seq = 0;
+static uint8_t telemetry_last[TELEMETRY_FIELDS];
+
+// --- Estado de salidas hacia la MMU (UART2) ---
+// Copia de LATD..LATJ de la ltima trama aceptada por el anillo TX.
+#define MMU_OUTPUT_PORTS        5
+#define MMU_HEARTBEAT_MS        250
+static uint8_t mmu_output_last[MMU_OUTPUT_PORTS];
+static bool mmu_output_sent = false;    // false: la prxima pasada enva siempre
+static uint8_t mmu_output_seq = 0;
+static uint16_t mmu_output_last_ms = 0;
+
+// --- Trabajos en segundo plano (0x23, 0x40, 0xF0) ---
+// Cada trabajo espera a que la cola de la EEPROM grabe hasta su marca y
+// despus relee el registro afectado; UART_JobService enva el resultado.
+#define UART_MAX_JOBS 4
+typedef struct {
+    bool active;
+    uint8_t id;
+    uint8_t cmd;
+    uint8_t table;          // Registro a releer (EEPROM_Table) ...
+    uint8_t index;          // ... y su ndice
+    bool write_ok;          // Resultado del guardado (false = ya fallido)
+    bool silent;            // Pedido por difusin o grupo: sin trama de fin
+    uint16_t ticket;        // ltima escritura encolada por el trabajo
+    uint8_t seq;            // SEQ de la peticin, repetido en RESP_JOB_DONE
+    uint16_t start_ms;
+} UartJob;
+static UartJob uart_jobs[UART_MAX_JOBS];
+static uint8_t uart_next_job_id = 0;
+
+static UartJob *UART_JobAccept(UartPort *port, uint8_t cmd);
+static void UART_JobSubmit(UartJob *job, bool write_ok, uint8_t table, uint8_t index);
+static void UART_JobService(void);
 
-// Prototipo de la funcin que construye y enva una trama
-static void UART_Send_Frame(uint8_t cmd, uint8_t* payload, uint8_t len);
-
-// Prototipo interno para UART2 
-static void UART2_Send_Frame(uint8_t cmd, uint8_t* payload, uint8_t len);
+/**
+ * @brief Calcula SPBRG y BRGH para una velocidad a partir de _XTAL_FREQ.
+ * @details El AUSART del PIC18F8720 solo tiene generador de 8 bits, as que se
+ * prueba primero alta velocidad (Fosc/16) y luego baja (Fosc/64).
+ * @return false si ningn divisor queda dentro de UART_BAUD_MAX_ERROR_PCT.
+ */
+static bool UART_ComputeBaud(uint32_t baudrate, uint8_t *spbrg, bool *brgh) {
+    uint32_t divisor = 16;
+    uint32_t n = (_XTAL_FREQ + (divisor * baudrate) / 2) / (divisor * baudrate);
+    *brgh = true;
+    if (n > 256) {
+        divisor = 64;
+        n = (_XTAL_FREQ + (divisor * baudrate) / 2) / (divisor * baudrate);
+        *brgh = false;
+    }
+    if (n == 0 || n > 256) return false;
 
-// Prototipo de la funcin que construye y enva una trama
-//static void UART_Send_Frame(uint8_t cmd, uint8_t* payload, uint8_t len);
+    uint32_t actual = _XTAL_FREQ / (divisor * n);
+    uint32_t error = (actual > baudrate) ? (actual - baudrate) : (baudrate - actual);
+    if (error * 100 > baudrate * UART_BAUD_MAX_ERROR_PCT) return false;
 
-#define UART_RESPONSE_BUFFER_SIZE 128
-//static char uart_response_buffer[UART_RESPONSE_BUFFER_SIZE];
+    *spbrg = (uint8_t)(n - 1);
+    return true;
+}
 
-static void UART_HandleCompleteFrame(uint8_t *buffer, uint8_t length);
+static void UART1_ApplyBaud(uint32_t baudrate) {
+    uint8_t spbrg;
+    bool brgh;
+    if (!UART_ComputeBaud(baudrate, &spbrg, &brgh)) {
+        UART_ComputeBaud(UART_DEFAULT_BAUD, &spbrg, &brgh);
+    }
+    TXSTA1bits.BRGH = brgh;
+    SPBRG1 = spbrg;
+}
 
-static void UART2_HandleCompleteFrame(uint8_t *buffer, uint8_t length);
+/**
+ * @brief Cuenta el plazo de confirmacin tras un cambio de velocidad (cada segundo).
+ * @details Si el anfitrin no confirma a la nueva velocidad, se vuelve a la anterior.
+ */
+void UART_BaudTick(void) {
+    if (baud_confirm_timer_s > 0 && --baud_confirm_timer_s == 0) {
+        uart1_baud = baud_previous;
+        UART1_ApplyBaud(uart1_baud);
+    }
+}
 
-// >>> NUEVO CERROJO (LOCK) POR SOFTWARE <<<
-static volatile bool g_uart_processing_lock = false;
+/**
+ * @brief Cuenta el plazo de confirmacin del modo CRC de ambos puertos (cada segundo).
+ */
+void UART_FrameCheckTick(void) {
+    UART_PortCheckTick(&uart1);
+    UART_PortCheckTick(&uart2);
+}
 
-void UART1_Init(uint32_t baudrate) {
-    TRISCbits.TRISC6 = 0; 
-    TRISCbits.TRISC7 = 1; 
-    TXSTA1 = 0x24;        
-    RCSTA1 = 0x90;        
-    SPBRG1 = 129; 
-    
-    PIE1bits.RC1IE = 1;
+static void UART_PortCheckTick(UartPort *port) {
+    if (port->check_confirm_s > 0 && --port->check_confirm_s == 0) {
+        port->crc_mode = false;
+    }
 }
 
-void UART2_Init(uint32_t baudrate) {
-    // Pines de UART2 en PIC18F8720: RG1 (TX2) y RG2 (RX2)
-    TRISGbits.TRISG1 = 0; // TX2 como salida
-    TRISGbits.TRISG2 = 1; // RX2 como entrada
-    
-    TXSTA2 = 0x24;        // TXEN=1 (Transmit enable), BRGH=1 (High speed)
-    RCSTA2 = 0x90;        // SPEN=1 (Serial port enable), CREN=1 (Continuous receive)
-    
-    // Clculo de Baud Rate (igual que UART1 para 9600 baud @ 20MHz)
-    // (20,000,000 / (16 * 9600)) - 1 = 129.2
-    SPBRG2 = 129; 
-    
-    PIE3bits.RC2IE = 1; // Habilitar interrupcin de recepcin de UART2
-    IPR3bits.RC2IP = 1; // Asignar alta prioridad
+/**
+ * @brief Aplica un cambio de velocidad pendiente cuando el ACK ya sali por completo.
+ */
+static void UART_BaudService(void) {
+    if (baud_pending == 0 || uart1.tx_head != uart1.tx_tail || !TXSTA1bits.TRMT) return;
+    baud_previous = uart1_baud;
+    uart1_baud = baud_pending;
+    baud_pending = 0;
+    UART1_ApplyBaud(uart1_baud);
+    baud_confirm_timer_s = UART_BAUD_CONFIRM_TIMEOUT_S;
 }
 
 
 void UART_Transmit_ISR(void) {
-    if (tx_head != tx_tail) {
-        TXREG1 = uart_tx_buffer[tx_tail];
-        tx_tail = (tx_tail + 1) % UART_TX_BUFFER_SIZE;
+    if (uart1.tx_head != uart1.tx_tail) {
+        TXREG1 = uart1.tx_buffer[uart1.tx_tail];
+        uart1.tx_tail = (uint8_t)((uart1.tx_tail + 1) % UART_TX_BUFFER_SIZE);
     } else {
         PIE1bits.TX1IE = 0;
     }
 }
 
-//Implementacin de UART2_Transmit_ISR 
 /**
  * @brief Manejador de interrupcin de transmisin para UART2.
  * @details Enva el siguiente byte del bfer circular de UART2.
  */
 void UART2_Transmit_ISR(void) {
-    if (tx2_head != tx2_tail) {
-        TXREG2 = uart2_tx_buffer[tx2_tail]; // Usa registro de UART2
-        tx2_tail = (tx2_tail + 1) % UART2_TX_BUFFER_SIZE; // Usa buffer de UART2
+    if (uart2.tx_head != uart2.tx_tail) {
+        TXREG2 = uart2.tx_buffer[uart2.tx_tail];
+        uart2.tx_tail = (uint8_t)((uart2.tx_tail + 1) % UART2_TX_BUFFER_SIZE);
     } else {
-        PIE3bits.TX2IE = 0; // Deshabilita interrupcin TX de UART2
+        PIE3bits.TX2IE = 0;
     }
 }
 
 
-void UART1_SendString(const char *str) {
-    while (*str) {
-        uart_tx_buffer[tx_head] = *str++;
-        tx_head = (tx_head + 1) % UART_TX_BUFFER_SIZE;
+/**
+ * @brief Bytes libres en el anillo de transmisin de un puerto.
+ */
+static uint8_t UART_PortTxFree(const UartPort *port) {
+    return (uint8_t)((port->tx_tail - port->tx_head - 1 + port->tx_size) % port->tx_size);
+}
+
+/**
+ * @brief Reserva espacio para un mensaje completo en el anillo de un puerto.
+ * @details Los bytes se escriben con UART_PortTxPut() a partir de tx_head, pero
+ * la ISR no los ve hasta UART_PortTxCommit(). Si no hay sitio no se escribe
+ * nada y se incrementa el contador de desbordes.
+ */
+static bool UART_PortTxReserve(UartPort *port, uint8_t len) {
+    if (len > UART_PortTxFree(port)) {
+        if (port->tx_overflows < 0xFFFF) port->tx_overflows++;
+        return false;
+    }
+    port->tx_reserve_head = port->tx_head;
+    return true;
+}
+
+static void UART_PortTxPut(UartPort *port, uint8_t byte) {
+    port->tx_buffer[port->tx_reserve_head] = byte;
+    port->tx_reserve_head = (uint8_t)((port->tx_reserve_head + 1) % port->tx_size);
+}
+
+static void UART_PortTxCommit(UartPort *port) {
+    port->tx_head = port->tx_reserve_head; // Publicar el mensaje completo de una vez
+    if (port->unit == 1) {
+        PIE1bits.TX1IE = 1;
+    } else {
+        PIE3bits.TX2IE = 1;
+    }
+}
+
+/**
+ * @brief Escribe un byte de la reserva y lo acumula en la suma (y el CRC).
+ */
+static void UART_PortTxPutChecked(UartPort *port, uint8_t byte, uint8_t *checksum, uint16_t *crc) {
+    UART_PortTxPut(port, byte);
+    *checksum += byte;
+    if (port->crc_mode) *crc = CRC16_Update(*crc, byte);
+}
+
+uint16_t UART_GetTxOverflowCount(void) {
+    return uart1.tx_overflows;
+}
+
+static void UART_PortAck(UartPort *port, uint8_t cmd) {
+    uint8_t payload[1];
+    payload[0] = cmd;
+    UART_PortReplyRecord(port, cmd, CMD_ACK, 0);
+    UART_PortSendFrame(port, CMD_ACK, payload, 1);
+}
+
+static void UART_PortNack(UartPort *port, uint8_t cmd, uint8_t error_code) {
+    uint8_t payload[2];
+    payload[0] = cmd;
+    payload[1] = error_code;
+    UART_PortReplyRecord(port, cmd, CMD_NACK, error_code);
+    UART_PortSendFrame(port, CMD_NACK, payload, 2);
+}
+
+/**
+ * @brief NACK con un tercer byte que indica el registro que fall.
+ */
+static void UART_PortNackIndex(UartPort *port, uint8_t cmd, uint8_t error_code, uint8_t index) {
+    uint8_t payload[3];
+    payload[0] = cmd;
+    payload[1] = error_code;
+    payload[2] = index;
+    UART_PortReplyRecord(port, cmd, CMD_NACK, error_code);
+    UART_PortSendFrame(port, CMD_NACK, payload, 3);
+}
+
+/**
+ * @brief Guarda la primera respuesta ACK/NACK/0x85 de la peticin secuenciada en curso.
+ * @details En NACK, error es el cdigo; en RESP_JOB_ACCEPTED, el id del
+ * trabajo. Solo se guardan resultados definitivos. ERROR_EXECUTION_FAIL indica
+ * que el comando no pudo ejecutarse en ese momento (sin ranuras de trabajo,
+ * transaccin ocupada...), as que la retransmisin vuelve a intentarlo.
+ */
+static void UART_PortReplyRecord(UartPort *port, uint8_t cmd, uint8_t reply, uint8_t error) {
+    UartSeqEntry *entry = port->seq_entry;
+    if (entry == NULL || entry->reply != 0 || entry->cmd != cmd) return;
+    if (reply == CMD_NACK && error == ERROR_EXECUTION_FAIL) return;
+    entry->reply = reply;
+    entry->error = error;
+}
+
+/**
+ * @brief Borra las entradas de la cach de SEQ que quedan fuera de la ventana
+ * que termina en el SEQ recibido (los SEQ van de 1 a 255, sin el 0).
+ */
+static void UART_SeqCacheExpire(UartPort *port) {
+    for (uint8_t i = 0; i < UART_SEQ_WINDOW; i++) {
+        UartSeqEntry *entry = &port->seq_cache[i];
+        if (entry->seq == 0) continue;
+        uint8_t age = (port->tx_seq >= entry->seq) ? (uint8_t)(port->tx_seq - entry->seq)
+                                                   : (uint8_t)(port->tx_seq + 255 - entry->seq);
+        if (age >= UART_SEQ_WINDOW) {
+            entry->seq = 0;
+            entry->reply = 0;
+        }
     }
-    PIE1bits.TX1IE = 1;
 }
 
 /**
@@ -114,9 +429,7 @@ void UART1_SendString(const char *str) {
  * @param original_cmd El comando que se est confirmando.
  */
 void UART_Send_ACK(uint8_t original_cmd) {
-    uint8_t payload[1];
-    payload[0] = original_cmd;
-    UART_Send_Frame(CMD_ACK, payload, 1);
+    UART_PortAck(&uart1, original_cmd);
 }
 
 /**
@@ -125,16 +438,13 @@ void UART_Send_ACK(uint8_t original_cmd) {
  * @param error_code El cdigo que especifica la razn del fallo.
  */
 void UART_Send_NACK(uint8_t original_cmd, uint8_t error_code) {
-    uint8_t payload[2];
-    payload[0] = original_cmd;
-    payload[1] = error_code;
-    UART_Send_Frame(CMD_NACK, payload, 2);
+    UART_PortNack(&uart1, original_cmd, error_code);
 }
 
 //funci+on para monitoreo y reporte
 void UART_Send_Monitoring_Report(uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ) {
     uint8_t payload[5];
-    
+
     // Construir el byte de estado peatonal combinando los 4 bits inferiores de H y J
     //uint8_t pedestrian_status = (portH & 0x0F) | ((portJ & 0x0F) << 4);
     // Dentro de la funcin UART_Send_Monitoring_Report
@@ -145,686 +455,1327 @@ void UART_Send_Monitoring_Report(uint8_t portD, uint8_t portE, uint8_t portF, ui
     payload[2] = portE;
     payload[3] = portF;
     payload[4] = pedestrian_status;
-    
-    UART_Send_Frame(CMD_MONITOR_STATUS_REPORT, payload, 5);
+
+    if (!UART_PortSpontaneousAllowed(&uart1)) return;
+    UART_PortSendFrame(&uart1, CMD_MONITOR_STATUS_REPORT, payload, 5);
+}
+
+/**
+ * @brief Enva un evento de diagnstico espontneo (cdigo EVT_* y dos argumentos).
+ * @details En modo bus se descarta: solo se habla para responder.
+ */
+void UART_Send_Event(uint8_t code, uint8_t arg0, uint8_t arg1) {
+    if (!UART_PortSpontaneousAllowed(&uart1)) return;
+    UART_PortSendEvent(&uart1, code, arg0, arg1);
+}
+
+/**
+ * @brief Enva un evento como respuesta a la peticin en curso del puerto.
+ */
+static void UART_PortSendEvent(UartPort *port, uint8_t code, uint8_t arg0, uint8_t arg1) {
+    uint8_t payload[3];
+    payload[0] = code;
+    payload[1] = arg0;
+    payload[2] = arg1;
+    UART_PortSendFrame(port, CMD_EVENT_REPORT, payload, 3);
+}
+
+/**
+ * @brief Indica si el puerto puede enviar tramas que no responden a una peticin.
+ * @details En el bus RS-485 multipunto solo habla el nodo al que se dirige la
+ * peticin en curso: una trama espontnea chocara con otros nodos o con el
+ * anfitrin.
+ */
+static bool UART_PortSpontaneousAllowed(const UartPort *port) {
+    return !port->addressed;
+}
+
+/**
+ * @brief Bytes que la trama aade al payload segn el modo del puerto:
+ * STX, CMD, LEN, CHK, ETX y, si estn activos, ADDR, SEQ y el 2 byte del CRC.
+ */
+static uint8_t UART_PortFrameOverhead(const UartPort *port) {
+    uint8_t overhead = 8;
+    if (port->addressed) overhead++;
+    if (port->sequenced) overhead++;
+    if (port->crc_mode) overhead++;
+    return overhead;
 }
 
 /**
- * @brief Funcin interna para construir y encolar cualquier trama de respuesta.
+ * @brief Construye y encola cualquier trama de respuesta en un puerto.
+ * @details La trama se escribe directamente en el anillo de transmisin
+ * (reserva/confirmacin). Si no cabe completa se descarta y se cuenta.
+ * En modo secuenciado lleva tx_seq: el de la peticin que se responde, o 0.
+ * En modo CRC el byte de suma se sustituye por el CRC-16 (alto, bajo) de los
+ * mismos bytes.
+ * @return false si la trama se descart.
  */
-static void UART_Send_Frame(uint8_t cmd, uint8_t* payload, uint8_t len) {
-    uint8_t frame[UART_TX_BUFFER_SIZE];
-    uint8_t frame_idx = 0;
-    uint8_t checksum = cmd + len;
+static bool UART_PortSendFrame(UartPort *port, uint8_t cmd, uint8_t *payload, uint8_t len) {
+    uint8_t checksum = 0;
+    uint16_t crc = CRC16_INIT;
 
-    // Encabezado
-    frame[frame_idx++] = 0x43;
-    frame[frame_idx++] = 0x53;
-    frame[frame_idx++] = 0x4F;
-    
-    // Comando y Longitud
-    frame[frame_idx++] = cmd;
-    frame[frame_idx++] = len;
+    if (port->mute) {
+        return true; // Difusin o grupo: nadie responde para no chocar en el bus
+    }
+    if (!UART_PortTxReserve(port, (uint8_t)(len + UART_PortFrameOverhead(port)))) {
+        return false;
+    }
+
+    // Encabezado, [Direccin,] [Secuencia,] Comando y Longitud
+    UART_PortTxPut(port, 0x43);
+    UART_PortTxPut(port, 0x53);
+    UART_PortTxPut(port, 0x4F);
+    if (port->addressed) {
+        UART_PortTxPutChecked(port, port->bus_addr, &checksum, &crc);
+    }
+    if (port->sequenced) {
+        UART_PortTxPutChecked(port, port->tx_seq, &checksum, &crc);
+    }
+    UART_PortTxPutChecked(port, cmd, &checksum, &crc);
+    UART_PortTxPutChecked(port, len, &checksum, &crc);
 
     // Payload y clculo de Checksum
     for(uint8_t i = 0; i < len; i++) {
-        frame[frame_idx++] = payload[i];
-        checksum += payload[i];
+        UART_PortTxPutChecked(port, payload[i], &checksum, &crc);
     }
 
-    // Checksum y Fin de Trama
-    frame[frame_idx++] = checksum;
-    frame[frame_idx++] = 0x03;
-    frame[frame_idx++] = 0xFF;
+    // Checksum (o CRC) y Fin de Trama
+    if (port->crc_mode) {
+        UART_PortTxPut(port, (uint8_t)(crc >> 8));
+        UART_PortTxPut(port, (uint8_t)(crc & 0xFF));
+    } else {
+        UART_PortTxPut(port, checksum);
+    }
+    UART_PortTxPut(port, 0x03);
+    UART_PortTxPut(port, 0xFF);
 
-    // Enviar la trama al buffer de transmisin
-    for(uint8_t i = 0; i < frame_idx; i++) {
-        uart_tx_buffer[tx_head] = frame[i];
-        tx_head = (tx_head + 1) % UART_TX_BUFFER_SIZE;
+    UART_PortTxCommit(port);
+    return true;
+}
+
+/**
+ * @brief Procesa como mucho una trama pendiente del puerto.
+ * @details La ranura en drain es propiedad del bucle principal hasta
+ * liberarla; mientras tanto la ISR sigue recibiendo en otra ranura.
+ */
+static void UART_PortTask(UartPort *port) {
+    if (port->rxq.ready == 0) {
+        return;
+    }
+    uint8_t slot = port->rxq.drain;
+    uint8_t addr = port->rxq.addr[slot];
+    if (port->sequenced) {
+        port->tx_seq = port->rxq.seq[slot];
+    }
+    port->mute = port->addressed && addr != port->bus_addr;
+    UART_PortDispatch(port, (uint8_t*)port->rxq.frame[slot], port->rxq.valid[slot]);
+    port->mute = false;
+    port->tx_seq = 0;
+    port->seq_entry = NULL;
+    UART_RxQueueRelease(&port->rxq);
+}
+
+void UART_Task(void) {
+    UART_BaudService();
+    if (dump_active) {
+        UART_DumpService();
     }
-    PIE1bits.TX1IE = 1; // Habilitar interrupcin de transmisin
+    UART_JobService();
+    UART_PortTask(&uart1);
 }
 
+void UART2_Task(void) {
+    UART_PortTask(&uart2);
+}
+
+uint16_t UART_GetRxDroppedCount(void) {
+    return uart1.rxq.dropped;
+}
+
+uint16_t UART_GetRxErrorCount(void) {
+    return uart1.rxq.errors;
+}
 
-// <<< --- INICIO DE LA MODIFICACIN --- >>>
 /**
- * @brief Funcin interna para construir y encolar cualquier trama de respuesta por UART2.
+ * @brief Libera la ranura ya procesada.
+ * @details La ISR calcula la ranura de escritura como drain + ready, as que
+ * ambos se actualizan juntos con interrupciones deshabilitadas: entre uno y
+ * otro la ISR apuntara a la ranura que se libera o a una an pendiente.
  */
-static void UART2_Send_Frame(uint8_t cmd, uint8_t* payload, uint8_t len) {
-    // Aseguramos que la trama quepa en el buffer
-    // (8 bytes de cabecera/cola + longitud)
-    if ((len + 8) > UART2_TX_BUFFER_SIZE) return; 
+static void UART_RxQueueRelease(volatile UartRxQueue *q) {
+    uint8_t gie = INTCONbits.GIE;
+    INTCONbits.GIE = 0;
+    q->drain = (uint8_t)((q->drain + 1) % UART_RX_FRAME_SLOTS);
+    q->ready--;
+    INTCONbits.GIE = gie;
+}
 
-    uint8_t frame_header_footer[8];
-    uint8_t frame_idx = 0;
-    uint8_t checksum = cmd + len;
+/**
+ * @brief Mquina de recepcin de tramas comn a UART1 y UART2 (desde la ISR).
+ * @details Busca el STX (43 53 4F), guarda CMD, LEN, payload, CHK y ETX en la
+ * ranura libre y, al validar 03 FF, la entrega a la cola. En modo bus el byte
+ * siguiente al STX es la direccin: si no es la propia, la de grupo o la de
+ * difusin, la trama se salta contando bytes, sin copiarla ni despacharla.
+ * En modo secuenciado el byte siguiente (tras la direccin, si la hay) es el
+ * SEQ, que se guarda aparte para que la ranura siga empezando por CMD.
+ * La suma (o el CRC-16) se acumula byte a byte segn llegan, as la trama
+ * queda validada al recibir el ETX.
+ */
+static void UART_RxQueueByte(UartPort *port, uint8_t byte) {
+    static const uint8_t stx_sequence[3] = {0x43, 0x53, 0x4F};
+    volatile UartRxQueue *q = &port->rxq;
+
+    q->idle_ms = 0;
+    if (q->skip > 0) {
+        if (--q->skip == 0 && q->skip_header) {
+            q->skip_header = false;
+            q->skip = (uint16_t)byte + (port->crc_mode ? 4 : 3); // payload + CHK/CRC + 03 FF
+        }
+        return;
+    }
 
-    // 1. Construir Encabezado, Comando y Longitud
-    frame_header_footer[frame_idx++] = 0x43;
-    frame_header_footer[frame_idx++] = 0x53;
-    frame_header_footer[frame_idx++] = 0x4F;
-    frame_header_footer[frame_idx++] = cmd;
-    frame_header_footer[frame_idx++] = len;
+    if (q->awaiting_addr) {
+        q->awaiting_addr = false;
+        if (byte != port->bus_addr && byte != UART_ADDR_BROADCAST &&
+            (port->bus_group == UART_ADDR_NONE || byte != port->bus_group)) {
+            // En modo bus SEQ y CRC son comunes a todo el bus (0x2A), as que
+            // el formato de la trama ajena es el mismo que el propio.
+            q->skip_header = true;
+            q->skip = port->sequenced ? 3 : 2; // [SEQ,] CMD y LEN
+            return;
+        }
+        if (q->ready >= UART_RX_FRAME_SLOTS) {
+            if (q->dropped < 0xFFFF) q->dropped++;
+            return;
+        }
+        q->addr[(uint8_t)((q->drain + q->ready) % UART_RX_FRAME_SLOTS)] = byte;
+        UART_RxCheckAdd(port, byte);
+        UART_RxFrameStart(port);
+        return;
+    }
 
-    // 2. Calcular Checksum del Payload
-    for(uint8_t i = 0; i < len; i++) {
-        checksum += payload[i];
+    if (q->awaiting_seq) {
+        q->awaiting_seq = false;
+        q->seq[(uint8_t)((q->drain + q->ready) % UART_RX_FRAME_SLOTS)] = byte;
+        UART_RxCheckAdd(port, byte);
+        q->receiving = true;
+        q->index = 0;
+        return;
     }
 
-    // 3. Construir Cola (Checksum y ETX)
-    frame_header_footer[frame_idx++] = checksum;
-    frame_header_footer[frame_idx++] = 0x03;
-    frame_header_footer[frame_idx++] = 0xFF;
+    if (!q->receiving) {
+        if (byte == stx_sequence[q->stx_counter]) {
+            if (++q->stx_counter >= 3) {
+                q->stx_counter = 0;
+                q->sum = 0;
+                q->crc = CRC16_INIT;
+                if (port->addressed) {
+                    // La ranura se comprueba tras la direccin: una trama
+                    // ajena no cuenta como descartada.
+                    q->awaiting_addr = true;
+                    return;
+                }
+                if (q->ready >= UART_RX_FRAME_SLOTS) {
+                    // Sin ranura libre: se ignora la trama completa.
+                    if (q->dropped < 0xFFFF) q->dropped++;
+                    return;
+                }
+                UART_RxFrameStart(port);
+            }
+        } else {
+            q->stx_counter = 0;
+        }
+        return;
+    }
 
+    uint8_t slot = (uint8_t)((q->drain + q->ready) % UART_RX_FRAME_SLOTS);
+    volatile uint8_t *buf = q->frame[slot];
+    if (q->index >= UART_RX_BUFFER_SIZE) {
+        UART_RxQueueAbort(q);
+        return;
+    }
+    if (q->index < 2 || q->index < (uint16_t)buf[1] + 2) {
+        UART_RxCheckAdd(port, byte); // CMD, LEN y payload
+    }
+    buf[q->index++] = byte;
+    if (q->index >= 2) {
+        uint8_t len = buf[1];
+        uint16_t total_expected_bytes = (uint16_t)len + (port->crc_mode ? 6 : 5);
+        if (q->index >= total_expected_bytes) {
+            if (buf[q->index - 2] == 0x03 && buf[q->index - 1] == 0xFF) {
+                if (port->crc_mode) {
+                    q->valid[slot] = (buf[2 + len] == (uint8_t)(q->crc >> 8) &&
+                                      buf[3 + len] == (uint8_t)(q->crc & 0xFF));
+                } else {
+                    q->valid[slot] = (buf[2 + len] == q->sum);
+                }
+                q->length[slot] = (uint8_t)(q->index - 2);
+                q->ready++;
+            } else if (q->errors < 0xFFFF) {
+                q->errors++;
+            }
+            q->receiving = false;
+        }
+    }
+}
 
-    // 4. --- LGICA CORREGIDA ---
-    // Deshabilitamos la interrupcin de TX ANTES de tocar el buffer
-    PIE3bits.TX2IE = 0; 
+/**
+ * @brief Acumula un byte cubierto por el checksum o el CRC (desde la ISR).
+ */
+static void UART_RxCheckAdd(UartPort *port, uint8_t byte) {
+    volatile UartRxQueue *q = &port->rxq;
+    if (port->crc_mode) {
+        q->crc = CRC16_Update(q->crc, byte);
+    } else {
+        q->sum += byte;
+    }
+}
 
-    // 4a. Aadir el encabezado (43 53 4F CMD LEN)
-    for(uint8_t i = 0; i < 5; i++) {
-        uart2_tx_buffer[tx2_head] = frame_header_footer[i];
-        tx2_head = (tx2_head + 1) % UART2_TX_BUFFER_SIZE;
+/**
+ * @brief Empieza a almacenar una trama en la ranura libre (desde la ISR).
+ */
+static void UART_RxFrameStart(UartPort *port) {
+    volatile UartRxQueue *q = &port->rxq;
+    if (port->sequenced) {
+        q->awaiting_seq = true;
+        return;
     }
-    
-    // 4b. Aadir el Payload
-    for(uint8_t i = 0; i < len; i++) {
-        uart2_tx_buffer[tx2_head] = payload[i];
-        tx2_head = (tx2_head + 1) % UART2_TX_BUFFER_SIZE;
+    q->receiving = true;
+    q->index = 0;
+}
+
+/**
+ * @brief Descarta la trama a medias y vuelve a buscar el STX (desde la ISR).
+ */
+static void UART_RxQueueAbort(volatile UartRxQueue *q) {
+    if (q->receiving || q->awaiting_addr || q->awaiting_seq || q->skip > 0) {
+        if (q->errors < 0xFFFF) q->errors++;
     }
+    q->receiving = false;
+    q->awaiting_addr = false;
+    q->awaiting_seq = false;
+    q->skip_header = false;
+    q->skip = 0;
+    q->stx_counter = 0;
+    q->idle_ms = 0;
+}
 
-    // 4c. Aadir la cola (CHK 03 FF)
-    for(uint8_t i = 5; i < 8; i++) {
-        uart2_tx_buffer[tx2_head] = frame_header_footer[i];
-        tx2_head = (tx2_head + 1) % UART2_TX_BUFFER_SIZE;
+/**
+ * @brief Cuenta el silencio de la trama en curso (cada 1 ms, desde la ISR).
+ */
+static void UART_RxQueueTick(volatile UartRxQueue *q) {
+    if (!q->receiving && !q->awaiting_addr && !q->awaiting_seq &&
+        q->skip == 0 && q->stx_counter == 0) {
+        return;
+    }
+    if (++q->idle_ms >= UART_RX_INTERBYTE_TIMEOUT_MS) {
+        UART_RxQueueAbort(q);
     }
+}
 
-    // 5. Habilitamos la interrupcin UNA SOLA VEZ al final.
-    PIE3bits.TX2IE = 1; 
+void UART_RxTimer_ISR(void) {
+    UART_RxQueueTick(&uart1.rxq);
+    UART_RxQueueTick(&uart2.rxq);
+}
+
+void UART_RxOverrun_ISR(void) {
+    UART_RxQueueAbort(&uart1.rxq);
+}
+
+void UART2_RxOverrun_ISR(void) {
+    UART_RxQueueAbort(&uart2.rxq);
+}
+
+void UART_ProcessReceivedByte(uint8_t byte) {
+    UART_RxQueueByte(&uart1, byte);
+}
+
+/**
+ * @brief Procesa un byte de UART2 (llamada desde la ISR).
+ * @details Misma mquina de recepcin que UART1, con su propia cola.
+ */
+void UART2_ProcessReceivedByte(uint8_t byte) {
+    UART_RxQueueByte(&uart2, byte);
 }
-// <<< --- FIN DE LA MODIFICACIN --- >>>
 
 // =============================================================================
-// >>> FUNCIN UART_Task MODIFICADA (Usa el cerrojo en lugar de deshabilitar la ISR) <<<
+// --- DESPACHO DE TRAMAS ---
 // =============================================================================
-void UART_Task(void) {
-    if (!g_frame_received) {
+
+/**
+ * @brief Despacha una trama completa (CMD, LEN, payload, CHK) a su manejador.
+ * @details La cola RX ya garantiza la longitud y trae el resultado del
+ * checksum o CRC en valid. Los errores de checksum, comando o longitud se
+ * responden con NACK solo si el puerto lo pide (reply_errors); si no, la
+ * trama se ignora. Las tramas de difusin o grupo se ejecutan sin
+ * respuesta. Una peticin secuenciada repetida cuya respuesta fue ACK/NACK
+ * recibe la respuesta guardada sin volver a ejecutarse.
+ */
+static void UART_PortDispatch(UartPort *port, uint8_t *buffer, bool valid) {
+    uint8_t cmd = buffer[0];
+    uint8_t len = buffer[1];
+    if (!valid) {
+        if (port->reply_errors) UART_PortNack(port, cmd, ERROR_CHECKSUM_INVALID);
         return;
     }
+    port->check_confirm_s = 0; // Una trama vlida confirma el modo de verificacin
 
-    // Ponemos el cerrojo para que la ISR no modifique el buffer mientras lo leemos.
-    g_uart_processing_lock = true;
+    if (port->sequenced && port->tx_seq != 0 && port->seq_cache != NULL) {
+        uint16_t check = CRC16_INIT;
+        for (uint8_t i = 0; i < (uint8_t)(len + 2); i++) {
+            check = CRC16_Update(check, buffer[i]);
+        }
+        UartSeqEntry *entry = &port->seq_cache[port->tx_seq % UART_SEQ_WINDOW];
+        if (entry->seq == port->tx_seq && entry->cmd == cmd && entry->check == check && entry->reply != 0) {
+            uint8_t payload[2];
+            payload[0] = cmd;
+            payload[1] = entry->error;
+            UART_PortSendFrame(port, entry->reply, payload, entry->reply == CMD_ACK ? 1 : 2);
+            return;
+        }
+        UART_SeqCacheExpire(port);
+        entry->seq = port->tx_seq;
+        entry->cmd = cmd;
+        entry->check = check;
+        entry->reply = 0;
+        port->seq_entry = entry;
+    }
 
-    // Procesamos la trama directamente desde el buffer global.
-    // Es seguro porque la ISR no escribir en l gracias al cerrojo.
-    UART_HandleCompleteFrame((uint8_t*)uart_rx_buffer, uart_rx_index);
+    const UartCommand *entry = NULL;
+    for (uint8_t i = 0; i < port->num_commands; i++) {
+        if (port->commands[i].cmd == cmd) {
+            entry = &port->commands[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (port->reply_errors) UART_PortNack(port, cmd, ERROR_UNKNOWN_CMD);
+        return;
+    }
+    if (entry->len != UART_LEN_ANY && len != entry->len) {
+        if (port->reply_errors) UART_PortNack(port, cmd, ERROR_INVALID_LENGTH);
+        return;
+    }
 
-    // Reseteamos la bandera de trama recibida.
-    g_frame_received = false;
+    if ((entry->flags & UART_CMD_CFG) && EEPROM_IsErasePending()) {
+        UART_PortNack(port, cmd, ERROR_EXECUTION_FAIL); // Pasajero: el anfitrin reintenta
+        return;
+    }
 
-    // Quitamos el cerrojo para permitir que la ISR reciba nuevas tramas.
-    g_uart_processing_lock = false;
+    if (entry->flags & UART_CMD_RTC) {
+        g_rtc_access_in_progress = true;
+        entry->handler(port, cmd, &buffer[2], len);
+        g_rtc_access_in_progress = false;
+    } else {
+        entry->handler(port, cmd, &buffer[2], len);
+    }
 }
 
-void UART2_Task(void) {
-    if (!g_uart2_frame_received) {
-        return;
+// =============================================================================
+// --- MANEJADORES DE COMANDOS DE UART1 ---
+// =============================================================================
+// La longitud fija y el bloqueo del RTC ya los comprob UART_PortDispatch
+// segn la tabla uart1_commands.
+
+// --- Comandos de EEPROM ---
+static void UART_Cmd_SaveControllerID(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    // Difusin y "sin grupo" no pueden ser la direccin propia en el bus;
+    // punto a punto se aceptan como antes (el bus los mapeara al valor por defecto)
+    if (port->addressed && (data[0] == UART_ADDR_BROADCAST || data[0] == UART_ADDR_NONE)) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    EEPROM_SaveControllerID(data[0]);
+    UART_PortAck(port, cmd); // Sale an con la direccin anterior
+    UART_BusReload();
+}
+
+static void UART_Cmd_ReadControllerID(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t payload[1];
+    payload[0] = EEPROM_ReadControllerID();
+    UART_PortSendFrame(port, RESP_CONTROLLER_ID, payload, 1);
+}
+
+// Mscaras de salida: data[0] = vehicular, data[1] = peatonal
+static void UART_Cmd_SaveOutputMasks(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    EEPROM_SaveOutputMasks(data[0], data[1]);
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_ReadOutputMasks(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t mask_v, mask_p;
+    EEPROM_ReadOutputMasks(&mask_v, &mask_p);
+
+    uint8_t payload[2];
+    payload[0] = mask_v;
+    payload[1] = mask_p;
+    UART_PortSendFrame(port, RESP_OUTPUT_MASKS_DATA, payload, 2);
+}
+
+static void UART_Cmd_ReadEepromStats(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    // Por tabla (orden de EEPROM_Table): grabados(2) + omitidos(2), MSB primero
+    uint8_t payload[EEPROM_NUM_TABLES * 4];
+    for (uint8_t t = 0; t < EEPROM_NUM_TABLES; t++) {
+        uint16_t performed, skipped;
+        EEPROM_GetWriteStats(t, &performed, &skipped);
+        payload[t * 4]     = (uint8_t)(performed >> 8);
+        payload[t * 4 + 1] = (uint8_t)(performed & 0xFF);
+        payload[t * 4 + 2] = (uint8_t)(skipped >> 8);
+        payload[t * 4 + 3] = (uint8_t)(skipped & 0xFF);
     }
+    UART_PortSendFrame(port, RESP_EEPROM_STATS_DATA, payload, sizeof(payload));
+}
 
-    // Ponemos el cerrojo para que la ISR no modifique el buffer de UART2.
-    g_uart2_processing_lock = true;
+static void UART_Cmd_ResetEepromStats(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    EEPROM_ResetWriteStats();
+    UART_PortAck(port, cmd);
+}
 
-    // Procesamos la trama directamente desde el buffer global de UART2.
-    UART2_HandleCompleteFrame((uint8_t*)uart2_rx_buffer, uart2_rx_index);
+static void UART_Cmd_ReadConfigIntegrity(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint16_t crc = EEPROM_GetStoredCRC();
+    uint8_t payload[3];
+    payload[0] = EEPROM_IsImageValid() ? 1 : 0;
+    payload[1] = (uint8_t)(crc >> 8);
+    payload[2] = (uint8_t)(crc & 0xFF);
+    UART_PortSendFrame(port, RESP_CONFIG_INTEGRITY, payload, 3);
+}
 
-    // Reseteamos la bandera de trama recibida.
-    g_uart2_frame_received = false;
+// Aceptar la configuracin actual y volver a sellar
+static void UART_Cmd_ResealConfig(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    EEPROM_ResealImage();
+    Scheduler_ReloadCache();
+    UART_PortAck(port, cmd);
+}
 
-    // Quitamos el cerrojo para permitir que la ISR reciba nuevas tramas.
-    g_uart2_processing_lock = false;
+// Plan, paso, ciclos y fallos
+static void UART_Cmd_ReadRuntimeState(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    RuntimeState state;
+    Sequence_Engine_GetRuntimeState(&state);
+    uint8_t payload[6];
+    payload[0] = (uint8_t)state.plan_id;
+    payload[1] = state.step;
+    payload[2] = (uint8_t)(state.cycles >> 8);
+    payload[3] = (uint8_t)(state.cycles & 0xFF);
+    payload[4] = (uint8_t)(state.faults >> 8);
+    payload[5] = (uint8_t)(state.faults & 0xFF);
+    UART_PortSendFrame(port, RESP_RUNTIME_STATE, payload, 6);
 }
 
-// =============================================================================
-// >>> FUNCIN UART_ProcessReceivedByte MODIFICADA (Usa el cerrojo) <<<
-// =============================================================================
-void UART_ProcessReceivedByte(uint8_t byte) {
-    // Si el bucle principal est procesando, ignoramos los bytes nuevos.
-    if (g_uart_processing_lock) {
+static void UART_Cmd_ReadCommStats(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t payload[6];
+    payload[0] = (uint8_t)(port->tx_overflows >> 8);
+    payload[1] = (uint8_t)(port->tx_overflows & 0xFF);
+    payload[2] = (uint8_t)(port->rxq.dropped >> 8);
+    payload[3] = (uint8_t)(port->rxq.dropped & 0xFF);
+    payload[4] = (uint8_t)(port->rxq.errors >> 8);
+    payload[5] = (uint8_t)(port->rxq.errors & 0xFF);
+    UART_PortSendFrame(port, RESP_COMM_STATS, payload, 6);
+}
+
+// Bloque de registros consecutivos, un solo ACK
+static void UART_Cmd_BulkWrite(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t failed_index;
+    uint8_t error = UART_HandleBulkWrite(data, len, &failed_index);
+    if (error == ERROR_EXECUTION_FAIL) {
+        UART_PortNackIndex(port, cmd, error, failed_index);
+    } else if (error != 0) {
+        UART_PortNack(port, cmd, error);
+    } else {
+        UART_PortAck(port, cmd);
+    }
+}
+
+// Fin de la carga masiva
+static void UART_Cmd_BulkCommit(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    Scheduler_ReloadCache();
+    Sequence_Engine_ReloadStepTable();
+    UART_PortAck(port, cmd);
+}
+
+// Iniciar volcado; los trozos salen desde UART_Task
+static void UART_Cmd_DumpImage(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    // En difusin o grupo todos los nodos volcaran a la vez y chocaran en el bus
+    if (port->mute) return;
+    dump_offset = 0;
+    dump_seq = 0;
+    dump_req_seq = port->tx_seq;
+    dump_crc = CRC16_INIT;
+    dump_active = true;
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_ConfigBegin(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (!EEPROM_BeginTransaction()) { UART_PortNack(port, cmd, ERROR_EXECUTION_FAIL); return; }
+    UART_PortAck(port, cmd);
+}
+
+// Validar y activar la configuracin preparada
+static void UART_Cmd_ConfigCommit(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (!EEPROM_IsTransactionOpen() || EEPROM_IsRollbackActive()) { UART_PortNack(port, cmd, ERROR_EXECUTION_FAIL); return; }
+    if (!EEPROM_CommitTransaction()) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    Scheduler_ApplyCommittedConfig();
+    UART_PortAck(port, cmd);
+}
+
+// Abortar: se restaura en segundo plano la configuracin anterior
+static void UART_Cmd_ConfigAbort(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (!EEPROM_IsTransactionOpen()) { UART_PortNack(port, cmd, ERROR_EXECUTION_FAIL); return; }
+    EEPROM_AbortTransaction();
+    UART_PortAck(port, cmd);
+}
+
+// --- Comandos de RTC (UART_CMD_RTC: el despacho bloquea el semforo) ---
+static void UART_Cmd_ReadTime(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    RTC_Time rtc;
+    RTC_GetTime(&rtc);
+
+    // El payload contiene los 7 bytes de la estructura RTC_Time
+    uint8_t payload[7];
+    payload[0] = rtc.hour;
+    payload[1] = rtc.minute;
+    payload[2] = rtc.second;
+    payload[3] = rtc.day;
+    payload[4] = rtc.month;
+    payload[5] = rtc.year;
+    payload[6] = rtc.dayOfWeek;
+    UART_PortSendFrame(port, RESP_RTC_TIME, payload, 7);
+}
+
+static void UART_Cmd_SetTime(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    RTC_Time new_time;
+    new_time.hour = data[0]; new_time.minute = data[1]; new_time.second = data[2];
+    new_time.day = data[3]; new_time.month = data[4]; new_time.year = data[5];
+    new_time.dayOfWeek = data[6];
+
+    RTC_SetTime(&new_time);
+    Scheduler_ReloadCache();
+    UART_PortAck(port, cmd);
+}
+
+// Trabajo en segundo plano: 0x85 al instante, 0x86 cuando el registro est grabado
+static void UART_Cmd_SaveMovement(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (data[0] >= MAX_MOVEMENTS_TOTAL) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    UartJob *job = UART_JobAccept(port, cmd);
+    if (job == NULL) return;
+    bool ok = EEPROM_SaveMovement(data[0], data[1], data[2], data[3], data[4], data[5], &data[6]);
+    Sequence_Engine_ReloadStepTable();
+    UART_JobSubmit(job, ok, EEPROM_TABLE_MOVEMENTS, data[0]);
+}
+
+static void UART_Cmd_ReadMovement(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t index = data[0];
+    uint8_t payload[1 + MOVEMENT_SIZE];
+    Movement *mov = (Movement *)&payload[1];
+
+    EEPROM_ReadMovement(index, mov);
+
+    // Se comprueba si el movimiento es vlido. Si no lo es, se enva un NACK.
+    if(!EEPROM_IsMovementValid(mov)){
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+    } else {
+        // Payload: ndice (para confirmacin) + registro tal cual.
+        payload[0] = index;
+        UART_PortSendFrame(port, RESP_MOVEMENT_DATA, payload, 1 + MOVEMENT_SIZE);
+    }
+}
+
+// Pruebas del RTC: el resultado vuelve como evento (CMD_EVENT_REPORT)
+static void UART_Cmd_RtcDirectTest(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    RTC_Time test_time = {12, 34, 56, 15, 11, 24, 5};
+    bool ok = RTC_SetTime(&test_time);
+    UART_PortSendEvent(port, EVT_RTC_TEST_SET_TIME, ok ? 1 : 0, 0);
+}
+
+static void UART_Cmd_RtcRamTest(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    bool ok = RTC_TestRAM();
+    UART_PortSendEvent(port, EVT_RTC_TEST_RAM, ok ? 1 : 0, 0);
+}
+
+static void UART_Cmd_RtcVisualTest(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    RTC_PerformVisualTest();
+    UART_PortSendEvent(port, EVT_RTC_TEST_VISUAL, 0, 0);
+}
+
+// Cambiar velocidad (el ACK sale a la velocidad actual)
+static void UART_Cmd_SetBaud(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t spbrg;
+    bool brgh;
+    if (data[0] >= sizeof(uart_baud_rates) / sizeof(uart_baud_rates[0]) ||
+        !UART_ComputeBaud(uart_baud_rates[data[0]], &spbrg, &brgh)) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
         return;
     }
+    UART_PortAck(port, cmd);
+    baud_pending = uart_baud_rates[data[0]];
+}
 
-    // La lgica inteligente de recepcin se mantiene igual.
-    static uint8_t stx_sequence[3] = {0x43, 0x53, 0x4F};
-    static uint8_t stx_counter = 0;
-    static bool receiving_in_progress = false;
+// Modo de trama de UART1 y direccin de grupo (se guardan en EEPROM)
+static void UART_Cmd_SetBusMode(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if ((data[0] & ~UART_BUS_MODE_MASK) != 0 ||
+        (data[0] != UART_BUS_MODE_POINT_TO_POINT && !(data[0] & UART_BUS_MODE_ADDRESSED)) ||
+        data[1] == UART_ADDR_BROADCAST) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+        return;
+    }
+    UART_PortAck(port, cmd);
+    EEPROM_SaveBusConfig(data[0], data[1]);
+    UART_BusReload();
+}
 
-    if (!receiving_in_progress) {
-        if (byte == stx_sequence[stx_counter]) {
-            if (++stx_counter >= 3) {
-                receiving_in_progress = true;
-                uart_rx_index = 0;
-                stx_counter = 0;
-            }
-        } else {
-            stx_counter = 0;
-        }
+// Modo secuenciado de UART1 (solo para la sesin, no se guarda)
+static void UART_Cmd_SetSeqMode(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    // En modo bus el formato es comn a todos los nodos: lo fija 0x2A.
+    if (data[0] > 1 || port->addressed) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+        return;
+    }
+    UART_PortAck(port, cmd); // Sale an con el formato anterior
+    port->sequenced = (data[0] != 0);
+    memset(uart1_seq_cache, 0, sizeof(uart1_seq_cache));
+}
+
+// Verificacin de trama del puerto: suma o CRC-16 (solo para la sesin)
+static void UART_Cmd_SetFrameCheck(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (data[0] > UART_FRAME_CHECK_CRC16 || port->addressed) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+        return;
+    }
+    UART_PortAck(port, cmd); // Sale an con el formato anterior
+    port->crc_mode = (data[0] == UART_FRAME_CHECK_CRC16);
+    port->check_confirm_s = port->crc_mode ? UART_CHECK_CONFIRM_TIMEOUT_S : 0;
+}
+
+// El anfitrin ya habla a la nueva velocidad
+static void UART_Cmd_ConfirmBaud(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (baud_confirm_timer_s == 0) { UART_PortNack(port, cmd, ERROR_EXECUTION_FAIL); return; }
+    baud_confirm_timer_s = 0;
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_SaveSequence(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    // Payload: 1(idx) + 1(tipo) + 1(pos_ancla) + 1(num_mov) + 12(ndices) = 16 bytes
+    // Secuencias en flash (idx >= MAX_SEQUENCES): tambin 4 + 24 ndices = 28 bytes.
+    if (len != 16 && !(len == 4 + MAX_SEQUENCE_STEPS && data[0] >= MAX_SEQUENCES)) {
+        UART_PortNack(port, cmd, ERROR_INVALID_LENGTH); return;
+    }
+    if (data[0] >= MAX_SEQUENCES_TOTAL || data[3] > len - 4) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA); return;
+    }
+
+    // data[2] es la POSICIN del ancla
+    EEPROM_SaveSequence(data[0], data[1], data[2], data[3], &data[4]);
+    Scheduler_ReloadCache();
+    Sequence_Engine_ReloadStepTable();
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_ReadSequence(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t sec_index = data[0];
+    Sequence seq;
+
+    EEPROM_ReadSequence(sec_index, &seq);
+
+    // Si no hay movimientos, se considera dato invlido y se enva NACK.
+    if(seq.num_movements == 0){
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
     } else {
-        if (uart_rx_index < UART_RX_BUFFER_SIZE) {
-            uart_rx_buffer[uart_rx_index++] = byte;
-            if (uart_rx_index >= 2) {
-                uint8_t payload_len = uart_rx_buffer[1];
-                uint16_t total_expected_bytes = payload_len + 5;
-                if (uart_rx_index >= total_expected_bytes) {
-                    if (uart_rx_buffer[uart_rx_index - 2] == 0x03 && uart_rx_buffer[uart_rx_index - 1] == 0xFF) {
-                        g_frame_received = true;
-                        uart_rx_index -= 2;
-                    }
-                    receiving_in_progress = false;
-                }
-            }
-        } else {
-            receiving_in_progress = false;
+        // Payload de tamao fijo: 16 bytes, o 28 si la secuencia supera los 12 pasos.
+        uint8_t slots = (seq.num_movements > MAX_EEPROM_SEQUENCE_STEPS) ? MAX_SEQUENCE_STEPS : MAX_EEPROM_SEQUENCE_STEPS;
+        uint8_t payload[4 + MAX_SEQUENCE_STEPS];
+        payload[0] = sec_index;
+        payload[1] = seq.type;
+        payload[2] = seq.anchor_step;
+        payload[3] = seq.num_movements;
+        for(uint8_t i = 0; i < slots; i++){
+            // Se rellenan los ndices usados y el resto con 0xFF.
+            payload[4+i] = (i < seq.num_movements) ? seq.movement_indices[i] : 0xFF;
         }
+        UART_PortSendFrame(port, RESP_SEQUENCE_DATA, payload, 4 + slots);
     }
 }
 
+// Trabajo en segundo plano: 0x85 al instante, 0x86 cuando el registro est grabado
+static void UART_Cmd_SavePlan(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (data[0] >= MAX_PLANS_TOTAL) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    UartJob *job = UART_JobAccept(port, cmd);
+    if (job == NULL) return;
+    bool ok = EEPROM_SavePlan(data[0], data[1], data[2], data[3], data[4], data[5]);
+    Scheduler_ReloadCache();
+    UART_JobSubmit(job, ok, EEPROM_TABLE_PLANS, data[0]);
+}
 
-/**
- * @brief Procesa un byte de UART2 (llamada desde la ISR).
- * @details Esta es una copia de la lgica de UART1, pero usa las variables
- * y banderas de UART2.
- */
-void UART2_ProcessReceivedByte(uint8_t byte) {
-    // Si el bucle principal (UART2_Task) est procesando, ignoramos.
-    if (g_uart2_processing_lock) {
+static void UART_Cmd_ReadPlan(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t plan_index = data[0];
+    uint8_t payload[1 + PLAN_SIZE];
+    Plan *plan = (Plan *)&payload[1];
+
+    EEPROM_ReadPlan(plan_index, plan);
+
+    // 0xFF es el valor por defecto de una EEPROM borrada.
+    if (plan->id_tipo_dia == 0xFF) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+    } else {
+        payload[0] = plan_index;
+        UART_PortSendFrame(port, RESP_PLAN_DATA, payload, 1 + PLAN_SIZE);
+    }
+}
+
+static void UART_Cmd_SaveIntermittence(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    EEPROM_SaveIntermittence(data[0], data[1], data[2], data[3], data[4], data[5]);
+    Sequence_Engine_ReloadStepTable();
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_ReadIntermittence(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t slot_index = data[0];
+    uint8_t id_plan, mov_idx, mask_d, mask_e, mask_f;
+
+    EEPROM_ReadIntermittence(slot_index, &id_plan, &mov_idx, &mask_d, &mask_e, &mask_f);
+
+    if (id_plan == 0xFF) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+    } else {
+        uint8_t payload[6];
+        payload[0] = slot_index;
+        payload[1] = id_plan;
+        payload[2] = mov_idx;
+        payload[3] = mask_d;
+        payload[4] = mask_e;
+        payload[5] = mask_f;
+        UART_PortSendFrame(port, RESP_INTERMIT_DATA, payload, 6);
+    }
+}
+
+static void UART_Cmd_SaveHoliday(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    EEPROM_SaveHoliday(data[0], data[1], data[2]);
+    Scheduler_ReloadCache();
+    UART_PortAck(port, cmd);
+}
+
+// Leer UN feriado; para leer todos, el software itera de 0 a MAX_HOLIDAYS-1.
+static void UART_Cmd_ReadHoliday(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t index = data[0];
+    if (index >= MAX_HOLIDAYS) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
         return;
     }
 
-    // Lgica de recepcin para la MMU
-    // (Asumimos el mismo formato de trama por ahora, esto se puede cambiar)
-    static uint8_t stx_sequence[3] = {0x43, 0x53, 0x4F}; // <--- Usa MMU el mismo STX?
-    static uint8_t stx_counter = 0;
-    static bool receiving_in_progress = false;
+    uint8_t day, month;
+    EEPROM_ReadHoliday(index, &day, &month);
 
-    if (!receiving_in_progress) {
-        if (byte == stx_sequence[stx_counter]) {
-            if (++stx_counter >= 3) {
-                receiving_in_progress = true;
-                uart2_rx_index = 0; // Usa buffer UART2
-                stx_counter = 0;
-            }
-        } else {
-            stx_counter = 0;
-        }
+    if (day == 0xFF || month == 0xFF) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
     } else {
-        if (uart2_rx_index < UART_RX_BUFFER_SIZE) {
-            uart2_rx_buffer[uart2_rx_index++] = byte; // Usa buffer UART2
-            if (uart2_rx_index >= 2) {
-                uint8_t payload_len = uart2_rx_buffer[1];
-                uint16_t total_expected_bytes = payload_len + 5;
-                if (uart2_rx_index >= total_expected_bytes) {
-                    if (uart2_rx_buffer[uart2_rx_index - 2] == 0x03 && uart2_rx_buffer[uart2_rx_index - 1] == 0xFF) {
-                        g_uart2_frame_received = true; // <--- Bandera de UART2
-                        uart2_rx_index -= 2;
-                    }
-                    receiving_in_progress = false;
-                }
-            }
-        } else {
-            receiving_in_progress = false;
-        }
+        uint8_t payload[3];
+        payload[0] = index;
+        payload[1] = day;
+        payload[2] = month;
+        UART_PortSendFrame(port, RESP_HOLIDAY_DATA, payload, 3);
+    }
+}
+
+static void UART_Cmd_SaveFlowRule(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    // Payload: 1(rule_idx) + 1(sec_idx) + 1(orig_mov) + 1(type) + 1(mask) + 1(dest_mov) = 6 bytes
+    // Opcional: + 1(accin) = 7 bytes. Sin accin se guarda como regla antigua (GOTO_STEP).
+    if (len != 6 && len != 7) { UART_PortNack(port, cmd, ERROR_INVALID_LENGTH); return; }
+    uint8_t action = (len == 7) ? data[6] : RULE_ACTION_LEGACY;
+    EEPROM_SaveFlowRule(data[0], data[1], data[2], data[3], data[4], data[5], action);
+    Sequence_Engine_ReloadStepTable();
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_ReadFlowRule(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t rule_index = data[0];
+    uint8_t payload[1 + FLOW_CONTROL_RULE_SIZE];
+    FlowRule *rule = (FlowRule *)&payload[1];
+
+    EEPROM_ReadFlowRule(rule_index, rule);
+
+    if (rule->sec_index == 0xFF) {
+        UART_PortNack(port, cmd, ERROR_INVALID_DATA);
+    } else {
+        payload[0] = rule_index;
+        // Las reglas antiguas se devuelven con el formato de 6 bytes de siempre.
+        UART_PortSendFrame(port, RESP_FLOW_RULE_DATA, payload, (rule->action == RULE_ACTION_LEGACY) ? FLOW_CONTROL_RULE_SIZE : 1 + FLOW_CONTROL_RULE_SIZE);
     }
 }
 
+static void UART_Cmd_MonitorEnable(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (!UART_PortSpontaneousAllowed(port)) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    g_monitoring_active = true;
+    UART_PortAck(port, cmd);
+}
+
+static void UART_Cmd_MonitorDisable(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    g_monitoring_active = false;
+    UART_PortAck(port, cmd);
+}
+
+// Periodo de la telemetra en dcimas de segundo (0 = apagada)
+static void UART_Cmd_SetTelemetry(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    if (data[0] > TELEMETRY_MAX_PERIOD) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    if (data[0] != 0 && !UART_PortSpontaneousAllowed(port)) { UART_PortNack(port, cmd, ERROR_INVALID_DATA); return; }
+    telemetry_period = data[0];
+    telemetry_countdown = data[0];
+    telemetry_keyframe_countdown = 0;
+    UART_PortAck(port, cmd);
+}
+
+// Trabajo en segundo plano: termina cuando la cabecera reescrita est grabada
+static void UART_Cmd_FactoryReset(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    UartJob *job = UART_JobAccept(port, cmd);
+    if (job == NULL) return;
+
+    EEPROM_EraseAll();
+    EEPROM_InitStructure();
+    Scheduler_ReloadCache();
+    Sequence_Engine_EnterFallback();
+    UART_BusReload();
+    UART_JobSubmit(job, true, EEPROM_TABLE_SYSTEM, 0);
+}
+
+// --- Tabla de comandos de UART1 (PC / GUI) ---
+static const UartCommand uart1_commands[] = {
+    { 0x10,                      1,            0,            UART_Cmd_SaveControllerID },
+    { 0x11,                      0,            0,            UART_Cmd_ReadControllerID },
+    { CMD_SAVE_OUTPUT_MASKS,     2,            0,            UART_Cmd_SaveOutputMasks },
+    { CMD_READ_OUTPUT_MASKS,     0,            0,            UART_Cmd_ReadOutputMasks },
+    { CMD_READ_EEPROM_STATS,     0,            0,            UART_Cmd_ReadEepromStats },
+    { CMD_RESET_EEPROM_STATS,    0,            0,            UART_Cmd_ResetEepromStats },
+    { CMD_READ_CONFIG_INTEGRITY, 0,            0,            UART_Cmd_ReadConfigIntegrity },
+    { CMD_RESEAL_CONFIG,         0,            0,            UART_Cmd_ResealConfig },
+    { CMD_READ_RUNTIME_STATE,    0,            0,            UART_Cmd_ReadRuntimeState },
+    { CMD_READ_COMM_STATS,       0,            0,            UART_Cmd_ReadCommStats },
+    { CMD_BULK_WRITE,            UART_LEN_ANY, UART_CMD_CFG, UART_Cmd_BulkWrite },
+    { CMD_BULK_COMMIT,           0,            0,            UART_Cmd_BulkCommit },
+    { CMD_DUMP_IMAGE,            0,            0,            UART_Cmd_DumpImage },
+    { CMD_CONFIG_BEGIN,          0,            0,            UART_Cmd_ConfigBegin },
+    { CMD_CONFIG_COMMIT,         0,            0,            UART_Cmd_ConfigCommit },
+    { CMD_CONFIG_ABORT,          0,            0,            UART_Cmd_ConfigAbort },
+    { 0x21,                      0,            UART_CMD_RTC, UART_Cmd_ReadTime },
+    { 0x22,                      7,            UART_CMD_RTC, UART_Cmd_SetTime },
+    { 0x23,                      11,           UART_CMD_CFG, UART_Cmd_SaveMovement },
+    { 0x24,                      1,            0,            UART_Cmd_ReadMovement },
+    { 0x25,                      UART_LEN_ANY, UART_CMD_RTC, UART_Cmd_RtcDirectTest },
+    { 0x26,                      UART_LEN_ANY, UART_CMD_RTC, UART_Cmd_RtcRamTest },
+    { 0x27,                      UART_LEN_ANY, UART_CMD_RTC, UART_Cmd_RtcVisualTest },
+    { CMD_SET_BAUD,              1,            0,            UART_Cmd_SetBaud },
+    { CMD_CONFIRM_BAUD,          0,            0,            UART_Cmd_ConfirmBaud },
+    { CMD_SET_BUS_MODE,          2,            0,            UART_Cmd_SetBusMode },
+    { CMD_SET_SEQ_MODE,          1,            0,            UART_Cmd_SetSeqMode },
+    { CMD_SET_FRAME_CHECK,       1,            0,            UART_Cmd_SetFrameCheck },
+    { 0x30,                      UART_LEN_ANY, UART_CMD_CFG, UART_Cmd_SaveSequence },
+    { 0x31,                      1,            0,            UART_Cmd_ReadSequence },
+    { 0x40,                      6,            UART_CMD_CFG, UART_Cmd_SavePlan },
+    { 0x41,                      1,            0,            UART_Cmd_ReadPlan },
+    { 0x50,                      6,            UART_CMD_CFG, UART_Cmd_SaveIntermittence },
+    { 0x51,                      1,            0,            UART_Cmd_ReadIntermittence },
+    { 0x60,                      3,            UART_CMD_CFG, UART_Cmd_SaveHoliday },
+    { 0x61,                      1,            0,            UART_Cmd_ReadHoliday },
+    { 0x70,                      UART_LEN_ANY, UART_CMD_CFG, UART_Cmd_SaveFlowRule },
+    { 0x71,                      1,            0,            UART_Cmd_ReadFlowRule },
+    { CMD_MONITOR_ENABLE,        0,            0,            UART_Cmd_MonitorEnable },
+    { CMD_MONITOR_DISABLE,       0,            0,            UART_Cmd_MonitorDisable },
+    { CMD_SET_TELEMETRY,         1,            0,            UART_Cmd_SetTelemetry },
+    { 0xF0,                      0,            0,            UART_Cmd_FactoryReset },
+};
+
 // =============================================================================
-// --- FUNCIN INTERNA PARA MANEJAR TRAMAS ---
+// --- MANEJADORES DE COMANDOS DE UART2 (MMU) ---
 // =============================================================================
-// Esta funcin procesa una trama completa recibida por la UART.
-// Se hace 'static' porque es una funcin interna de este mdulo.
-static void UART_HandleCompleteFrame(uint8_t *buffer, uint8_t length) {
-    uint8_t cmd = buffer[0];
-    uint8_t len = buffer[1];
-    if (length != (len + 3)) {
-        UART1_SendString("ERROR: Inconsistencia en longitud\r\n");
-        return;
+
+// La MMU solicita la configuracin de salidas
+static void UART2_Cmd_GetConfig(UartPort *port, uint8_t cmd, uint8_t *data, uint8_t len) {
+    uint8_t mask_v, mask_p;
+    EEPROM_ReadOutputMasks(&mask_v, &mask_p);
+
+    uint8_t payload[2];
+    payload[0] = mask_v; // Mscara vehicular
+    payload[1] = mask_p; // Mscara peatonal
+    UART_PortSendFrame(port, RESP_MMU_CONFIG_DATA, payload, 2);
+}
+
+// --- Tabla de comandos de UART2 (MMU) ---
+static const UartCommand uart2_commands[] = {
+    { CMD_MMU_GET_CONFIG,        0,            0,            UART2_Cmd_GetConfig },
+    { CMD_SET_FRAME_CHECK,       1,            0,            UART_Cmd_SetFrameCheck },
+};
+
+#define UART1_NUM_COMMANDS (sizeof(uart1_commands) / sizeof(uart1_commands[0]))
+#define UART2_NUM_COMMANDS (sizeof(uart2_commands) / sizeof(uart2_commands[0]))
+
+// =============================================================================
+// --- INICIALIZACIN DE PUERTOS ---
+// =============================================================================
+// Va despus de las tablas porque cada puerto se enlaza con la suya.
+
+/**
+ * @brief Deja un puerto con anillos vacos y su tabla de comandos.
+ */
+static void UART_PortInit(UartPort *port, uint8_t unit, volatile uint8_t *tx_buffer, uint8_t tx_size,
+                          const UartCommand *commands, uint8_t num_commands, bool reply_errors) {
+    memset(port, 0, sizeof(*port));
+    port->unit = unit;
+    port->tx_buffer = tx_buffer;
+    port->tx_size = tx_size;
+    port->commands = commands;
+    port->num_commands = num_commands;
+    port->reply_errors = reply_errors;
+}
+
+void UART1_Init(uint32_t baudrate) {
+    UART_PortInit(&uart1, 1, uart_tx_buffer, UART_TX_BUFFER_SIZE,
+                  uart1_commands, UART1_NUM_COMMANDS, true);
+    uart1.seq_cache = uart1_seq_cache;
+    UART_BusReload();
+
+    TRISCbits.TRISC6 = 0;
+    TRISCbits.TRISC7 = 1;
+    TXSTA1 = 0x20;        // TXEN=1; BRGH lo decide UART1_ApplyBaud
+    RCSTA1 = 0x90;
+    UART1_ApplyBaud(baudrate);
+    uart1_baud = baudrate;
+
+    PIE1bits.RC1IE = 1;
+}
+
+/**
+ * @brief Carga de la EEPROM el modo de trama de UART1 y sus direcciones.
+ * @details La direccin propia es el ID del controlador. UART2 (MMU) es
+ * siempre punto a punto.
+ */
+static void UART_BusReload(void) {
+    uint8_t mode, group;
+    EEPROM_ReadBusConfig(&mode, &group);
+    if (mode & ~UART_BUS_MODE_MASK) {
+        mode = UART_BUS_MODE_POINT_TO_POINT; // EEPROM sin formatear (0xFF)
     }
-    uint8_t chk_calc = cmd + len;
-    for (uint8_t i = 0; i < len; i++) chk_calc += buffer[2 + i];
-    uint8_t chk_received = buffer[2 + len];
-    if (chk_calc != chk_received) {
-        UART_Send_NACK(cmd, ERROR_CHECKSUM_INVALID);
-        return;
+    bool addressed = (mode & UART_BUS_MODE_ADDRESSED) != 0;
+    bool sequenced = uart1.sequenced;
+    uart1.bus_addr = EEPROM_ReadControllerID();
+    if (uart1.bus_addr == UART_ADDR_BROADCAST || uart1.bus_addr == UART_ADDR_NONE) {
+        uart1.bus_addr = UART_ADDR_DEFAULT; // EEPROM sin formatear o ID de una versin anterior
     }
+    uart1.bus_group = group;
+    if (addressed) {
+        // SEQ y CRC son del bus, no de la sesin: todos los nodos deben poder
+        // saltar las tramas ajenas contando los mismos bytes.
+        sequenced = (mode & UART_BUS_MODE_SEQ) != 0;
+        uart1.crc_mode = (mode & UART_BUS_MODE_CRC16) != 0;
+        uart1.check_confirm_s = 0; // Configuracin guardada: no caduca
+    } else if (uart1.addressed) {
+        sequenced = false; // Al salir del bus se vuelve a la trama bsica
+        uart1.crc_mode = false;
+    }
+    if (sequenced != uart1.sequenced) {
+        memset(uart1_seq_cache, 0, sizeof(uart1_seq_cache));
+        uart1.sequenced = sequenced;
+    }
+    uart1.addressed = addressed;
+}
 
-    // --- Estructura de comandos ---
-    switch(cmd){
-        
-        // --- Comandos de EEPROM (no requieren bloqueo de RTC) ---
-        case 0x10: { // Guardar ID
-            if(len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            EEPROM_SaveControllerID(buffer[2]);
-            UART_Send_ACK(cmd);
-            break;
-        }
-        case 0x11: { // Leer ID de controlador
-            if(len != 0) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t id = EEPROM_ReadControllerID();
-            
-            // Se construye el payload con el dato ledo
-            uint8_t payload[1];
-            payload[0] = id;
-            
-            // Se enva la trama de respuesta binaria, no texto.
-            UART_Send_Frame(RESP_CONTROLLER_ID, payload, 1);
-            break;
-        }
-        
-        //  Manejador para Comandos de Mscaras para saber que salidas estaran trabajando
-        case CMD_SAVE_OUTPUT_MASKS: { // 0x12: Guardar Mscaras de Salida
-            if(len != 2) { 
-                UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); 
-                break; 
-            }
-            // buffer[2] = Mscara Vehicular
-            // buffer[3] = Mscara Peatonal
-            EEPROM_SaveOutputMasks(buffer[2], buffer[3]);
-            UART_Send_ACK(cmd);
-            break;
-        }
+void UART2_Init(uint32_t baudrate) {
+    // La MMU no recibe NACK: las tramas invlidas se ignoran como siempre.
+    UART_PortInit(&uart2, 2, uart2_tx_buffer, UART2_TX_BUFFER_SIZE,
+                  uart2_commands, UART2_NUM_COMMANDS, false);
 
-        case CMD_READ_OUTPUT_MASKS: { // 0x13: Leer Mscaras de Salida
-            if(len != 0) { 
-                UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); 
-                break; 
-            }
-            
-            uint8_t mask_v, mask_p;
-            EEPROM_ReadOutputMasks(&mask_v, &mask_p);
-            
-            uint8_t payload[2];
-            payload[0] = mask_v;
-            payload[1] = mask_p;
-            
-            UART_Send_Frame(RESP_OUTPUT_MASKS_DATA, payload, 2);
-            break;
-        }
-        
-        // --- Comandos de RTC (requieren bloqueo con semforo) ---
-        case 0x21: { // Consultar Hora
-            if(len != 0) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            
-            g_rtc_access_in_progress = true;
-            RTC_Time rtc;
-            RTC_GetTime(&rtc);
-            g_rtc_access_in_progress = false;
-            
-            // El payload contiene los 7 bytes de la estructura RTC_Time
-            uint8_t payload[7];
-            payload[0] = rtc.hour;
-            payload[1] = rtc.minute;
-            payload[2] = rtc.second;
-            payload[3] = rtc.day;
-            payload[4] = rtc.month;
-            payload[5] = rtc.year;
-            payload[6] = rtc.dayOfWeek;
-
-            UART_Send_Frame(RESP_RTC_TIME, payload, 7);
-            break;
-        }
-        
-        case 0x22: { // Guardar Fecha/Hora
-            if (len != 7) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            RTC_Time new_time;
-            new_time.hour = buffer[2]; new_time.minute = buffer[3]; new_time.second = buffer[4];
-            new_time.day = buffer[5]; new_time.month = buffer[6]; new_time.year = buffer[7];
-            new_time.dayOfWeek = buffer[8];
-            
-            g_rtc_access_in_progress = true;
-            RTC_SetTime(&new_time);
-            g_rtc_access_in_progress = false;
-            Scheduler_ReloadCache();
-            UART_Send_ACK(cmd);
-            break;
-        }
-        
-        case 0x23: { // Guardar Movimiento
-            if (len != 11) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            
-            // --- INICIO DE LA CORRECCIN ---
-            // 1. Confirmar INMEDIATAMENTE que se recibi el comando.
-            UART_Send_ACK(cmd);
-            
-            // 2. Ahora, ejecutar la operacin de guardado.
-            EEPROM_SaveMovement(buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], &buffer[8]);
-            // --- FIN DE LA CORRECCIN ---
-
-            // El ACK ya se envi, por lo que la siguiente lnea se elimina o comenta.
-            // UART_Send_ACK(cmd); 
-            break;
-        }
+    // Pines de UART2 en PIC18F8720: RG1 (TX2) y RG2 (RX2)
+    TRISGbits.TRISG1 = 0; // TX2 como salida
+    TRISGbits.TRISG2 = 1; // RX2 como entrada
 
-        
-        case 0x24: { // Leer Movimiento
-            if(len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t index = buffer[2];
-            uint8_t portD, portE, portF, portH, portJ; 
-            uint8_t times[5];
-    
-            EEPROM_ReadMovement(index, &portD, &portE, &portF, &portH, &portJ, times);
-    
-            // Se comprueba si el movimiento es vlido. Si no lo es, se enva un NACK.
-            if(!EEPROM_IsMovementValid(portD, portE, portF, portH, portJ, times)){
-                UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-            } else {
-                // Si es vlido, se construye el payload con los datos binarios.
-                uint8_t payload[11];
-                payload[0] = index; // Se devuelve el ndice para confirmacin
-                payload[1] = portD;
-                payload[2] = portE;
-                payload[3] = portF;
-                payload[4] = portH;
-                payload[5] = portJ;
-                for(uint8_t i = 0; i < 5; i++) payload[6+i] = times[i];
-                
-                UART_Send_Frame(RESP_MOVEMENT_DATA, payload, 11);
-            }
-            break;
-        }
-        
-        case 0x25: { // Prueba directa al RTC
-            g_rtc_access_in_progress = true; // <<-- BLOQUEAR ACCESO
-            
-            UART1_SendString("DEBUG: Ejecutando prueba directa al RTC...\r\n");
-            RTC_Time test_time = {12, 34, 56, 15, 11, 24, 5};
-            if (RTC_SetTime(&test_time)) {
-                UART1_SendString("DEBUG: RTC_SetTime ejecutado. Consulta la hora.\r\n");
-            } else {
-                UART1_SendString("DEBUG: RTC_SetTime reporto un fallo.\r\n");
-            }
+    TXSTA2 = 0x20;        // TXEN=1 (Transmit enable)
+    RCSTA2 = 0x90;        // SPEN=1 (Serial port enable), CREN=1 (Continuous receive)
 
-            g_rtc_access_in_progress = false; // <<-- LIBERAR ACCESO
-            break;
-        }
-        case 0x26: { // Prueba de RAM del RTC
-            g_rtc_access_in_progress = true; // <<-- BLOQUEAR ACCESO
-            
-            UART1_SendString("DEBUG: Solicitando prueba de RAM al modulo RTC...\r\n");
-            if (RTC_TestRAM()) {
-                UART1_SendString("EXITO: La prueba de RAM del RTC fue exitosa.\r\n");
-            } else {
-                UART1_SendString("FALLO: La prueba de RAM del RTC ha fallado.\r\n");
-            }
-            
-            g_rtc_access_in_progress = false; // <<-- LIBERAR ACCESO
-            break;
-        }
-        case 0x27: { // Prueba Visual
-            g_rtc_access_in_progress = true; // <<-- BLOQUEAR ACCESO
-            
-            UART1_SendString("DEBUG: Solicitando prueba visual al modulo RTC...\r\n");
-            RTC_PerformVisualTest();
-            UART1_SendString("DEBUG: Prueba visual finalizada.\r\n");
-            
-            g_rtc_access_in_progress = false; // <<-- LIBERAR ACCESO
-            break;
-        }
-        
-        case 0x30: { // Guardar Secuencia
-            // Payload: 1(idx) + 1(tipo) + 1(pos_ancla) + 1(num_mov) + 12(ndices) = 16 bytes
-            if (len != 16) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            
-            // buffer[4] ahora es la POSICIN del ancla (0-11)
-            EEPROM_SaveSequence(buffer[2], buffer[3], buffer[4], buffer[5], &buffer[6]);
-            Scheduler_ReloadCache();
-            UART_Send_ACK(cmd);
-            break;
-        }
-        
-        case 0x31: { // Leer Secuencia
-            if(len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t sec_index = buffer[2];
-            uint8_t type, anchor_step_index, num_movements;
-            uint8_t movements_indices[12];
-
-            EEPROM_ReadSequence(sec_index, &type, &anchor_step_index, &num_movements, movements_indices);
-
-            // Si no hay movimientos, se considera dato invlido y se enva NACK.
-            if(num_movements == 0){
-                UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-            } else {
-                // Se construye un payload de tamao fijo (16 bytes).
-                uint8_t payload[16];
-                payload[0] = sec_index;
-                payload[1] = type;
-                payload[2] = anchor_step_index;
-                payload[3] = num_movements;
-                for(uint8_t i = 0; i < 12; i++){
-                    // Se rellenan los ndices usados y el resto con 0xFF.
-                    payload[4+i] = (i < num_movements) ? movements_indices[i] : 0xFF;
-                }
-                
-                UART_Send_Frame(RESP_SEQUENCE_DATA, payload, 16);
-            }
-            break;
-        }
-        
-        case 0x40: { // Guardar Plan
-            if(len != 6) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            
-            // --- INICIO DE LA CORRECCIN ---
-            // 1. Confirmar INMEDIATAMENTE que se recibi el comando.
-            UART_Send_ACK(cmd);
-
-            // 2. Ejecutar la operacin de guardado y recarga de cach.
-            EEPROM_SavePlan(buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7]);
-            Scheduler_ReloadCache();
-            // --- FIN DE LA CORRECCIN ---
-            
-            // El ACK ya se envi, por lo que la siguiente lnea se elimina o comenta.
-            // UART_Send_ACK(cmd);
-            break;
+    // Divisor calculado desde _XTAL_FREQ (129 con BRGH=1 para 9600 @ 20MHz)
+    uint8_t spbrg;
+    bool brgh;
+    if (!UART_ComputeBaud(baudrate, &spbrg, &brgh)) {
+        UART_ComputeBaud(UART_DEFAULT_BAUD, &spbrg, &brgh);
+    }
+    TXSTA2bits.BRGH = brgh;
+    SPBRG2 = spbrg;
+
+    PIE3bits.RC2IE = 1; // Habilitar interrupcin de recepcin de UART2
+    IPR3bits.RC2IP = 1; // Asignar alta prioridad
+}
+
+
+/**
+ * @brief Guarda un bloque de registros consecutivos de una tabla (comando 0x1A).
+ * @details El anfitrin parte la tabla en bloques que quepan en
+ * UART_RX_BUFFER_SIZE. Las cachs no se recargan aqu sino en CMD_BULK_COMMIT.
+ * Si un guardado falla se detiene en ese registro: los anteriores ya quedaron
+ * escritos y el anfitrin puede reenviar el bloque desde el ndice fallido.
+ * @param failed_index Recibe el ndice del registro que no se pudo guardar.
+ * @return 0 si se guard el bloque, o el cdigo de error para el NACK.
+ */
+static uint8_t UART_HandleBulkWrite(uint8_t *payload, uint8_t len, uint8_t *failed_index) {
+    static const uint8_t record_size[EEPROM_NUM_TABLES] = {
+        0,                      // SYSTEM (no admite carga masiva)
+        MOVEMENT_SIZE,          // D, E, F, H, J, 5 tiempos
+        SEQUENCE_SIZE,          // tipo, ancla, num_mov, 12 ndices
+        PLAN_SIZE,              // tipo_da, secuencia, time_sel, hora, minuto
+        INTERMITTENCE_SIZE,     // plan, movimiento, mscaras D/E/F
+        HOLIDAY_SIZE,           // da, mes
+        FLOW_CONTROL_RULE_SIZE  // secuencia, origen, tipo, mscara, destino, accin
+    };
+    static const uint8_t max_records[EEPROM_NUM_TABLES] = {
+        0, MAX_MOVEMENTS_TOTAL, MAX_SEQUENCES_TOTAL, MAX_PLANS_TOTAL, MAX_INTERMITENCES, MAX_HOLIDAYS, MAX_FLOW_CONTROL_RULES
+    };
+
+    if (len < 3) return ERROR_INVALID_LENGTH;
+    uint8_t table = payload[0];
+    uint8_t first = payload[1];
+    uint8_t count = payload[2];
+    if (table == EEPROM_TABLE_SYSTEM || table >= EEPROM_NUM_TABLES) return ERROR_INVALID_DATA;
+    if (len != 3 + count * record_size[table]) return ERROR_INVALID_LENGTH;
+    if (count == 0 || first >= max_records[table] || count > max_records[table] - first) return ERROR_INVALID_DATA;
+
+    uint8_t *r = &payload[3];
+    if (table == EEPROM_TABLE_SEQUENCES) {
+        // Los registros del bloque tienen 12 ndices: no admiten secuencias largas.
+        for (uint8_t i = 0; i < count; i++) {
+            if (r[i * SEQUENCE_SIZE + 2] > MAX_EEPROM_SEQUENCE_STEPS) return ERROR_INVALID_DATA;
         }
-        
-        case 0x41: { // Leer Plan
-            if(len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t plan_index = buffer[2];
-            uint8_t id_tipo_dia, sec_index, time_sel, hour, minute;
-
-            EEPROM_ReadPlan(plan_index, &id_tipo_dia, &sec_index, &time_sel, &hour, &minute);
-            
-            // 0xFF es el valor por defecto de una EEPROM borrada.
-            if (id_tipo_dia == 0xFF) {
-                UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-            } else {
-                uint8_t payload[6];
-                payload[0] = plan_index;
-                payload[1] = id_tipo_dia;
-                payload[2] = sec_index;
-                payload[3] = time_sel;
-                payload[4] = hour;
-                payload[5] = minute;
-                UART_Send_Frame(RESP_PLAN_DATA, payload, 6);
-            }
-            break;
+    }
+    for (uint8_t i = 0; i < count; i++, r += record_size[table]) {
+        uint8_t index = first + i;
+        bool ok = true;     // Las tablas sin guardado en flash solo fallan por rango, ya comprobado
+        switch (table) {
+            case EEPROM_TABLE_MOVEMENTS:      ok = EEPROM_SaveMovement(index, r[0], r[1], r[2], r[3], r[4], &r[5]); break;
+            case EEPROM_TABLE_SEQUENCES:      ok = EEPROM_SaveSequence(index, r[0], r[1], r[2], &r[3]); break;
+            case EEPROM_TABLE_PLANS:          ok = EEPROM_SavePlan(index, r[0], r[1], r[2], r[3], r[4]); break;
+            case EEPROM_TABLE_INTERMITENCES:  EEPROM_SaveIntermittence(index, r[0], r[1], r[2], r[3], r[4]); break;
+            case EEPROM_TABLE_HOLIDAYS:       EEPROM_SaveHoliday(index, r[0], r[1]); break;
+            case EEPROM_TABLE_FLOW_CONTROL:   EEPROM_SaveFlowRule(index, r[0], r[1], r[2], r[3], r[4], r[5]); break;
         }
-        
-        case 0x50: { // Guardar Intermitencia
-            if (len != 6) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            EEPROM_SaveIntermittence(buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7]);
-            UART_Send_ACK(cmd);
-            break;
+        if (!ok) {
+            *failed_index = index;
+            return ERROR_EXECUTION_FAIL;
         }
+    }
+    return 0;
+}
 
-        case 0x51: { // Leer Bloque de Intermitencia
-            if(len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t slot_index = buffer[2];
-            uint8_t id_plan, mov_idx, mask_d, mask_e, mask_f;
-
-            EEPROM_ReadIntermittence(slot_index, &id_plan, &mov_idx, &mask_d, &mask_e, &mask_f);
-
-            if (id_plan == 0xFF) {
-                 UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-            } else {
-                uint8_t payload[6];
-                payload[0] = slot_index;
-                payload[1] = id_plan;
-                payload[2] = mov_idx;
-                payload[3] = mask_d;
-                payload[4] = mask_e;
-                payload[5] = mask_f;
-                UART_Send_Frame(RESP_INTERMIT_DATA, payload, 6);
-            }
-            break;
-        }
-        
-        case 0x60: { // Guardar Feriado
-            if (len != 3) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            EEPROM_SaveHoliday(buffer[2], buffer[3], buffer[4]);
-            Scheduler_ReloadCache();
-            UART_Send_ACK(cmd);
-            break;
-        }
-        
-        case 0x61: { // Leer UN Feriado
-            if(len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t index = buffer[2];
-            
-            // Para leer todos, el software deber iterar desde el ndice 0 hasta MAX_HOLIDAYS-1.
-            if (index >= MAX_HOLIDAYS) {
-                UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-                break;
-            }
-            
-            uint8_t day, month;
-            EEPROM_ReadHoliday(index, &day, &month);
-            
-            if (day == 0xFF || month == 0xFF) {
-                UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-            } else {
-                uint8_t payload[3];
-                payload[0] = index;
-                payload[1] = day;
-                payload[2] = month;
-                UART_Send_Frame(RESP_HOLIDAY_DATA, payload, 3);
-            }
-            break;
+/**
+ * @brief Enva el siguiente trozo del volcado si cabe en el anillo TX.
+ * @details Se llama en cada pasada de UART_Task, as el volcado avanza al
+ * ritmo del puerto sin bloquear el bucle principal. Los rangos borrados
+ * (0xFF) se comprimen por longitud de racha.
+ */
+static void UART_DumpService(void) {
+    uint8_t payload[3 + DUMP_CHUNK_DATA_MAX];
+
+    if (UART_PortTxFree(&uart1) < sizeof(payload) + UART_PortFrameOverhead(&uart1)) return;
+
+    if (dump_offset >= EEPROM_SIZE) {
+        payload[0] = dump_seq;
+        payload[1] = (uint8_t)(EEPROM_SIZE >> 8);
+        payload[2] = (uint8_t)(EEPROM_SIZE & 0xFF);
+        payload[3] = (uint8_t)(dump_crc >> 8);
+        payload[4] = (uint8_t)(dump_crc & 0xFF);
+        uart1.tx_seq = dump_req_seq;
+        bool sent = UART_PortSendFrame(&uart1, RESP_DUMP_END, payload, 5);
+        uart1.tx_seq = 0;
+        if (sent) dump_active = false;
+        return;
+    }
+
+    uint16_t start_offset = dump_offset;
+    uint16_t start_crc = dump_crc;
+    uint8_t n = 3;
+    payload[0] = dump_seq;
+    payload[1] = (uint8_t)(dump_offset >> 8);
+    payload[2] = (uint8_t)(dump_offset & 0xFF);
+
+    // Cada vuelta aade como mucho 2 bytes (un par RLE)
+    while (dump_offset < EEPROM_SIZE && n <= (uint8_t)(sizeof(payload) - 2)) {
+        uint8_t value = EEPROM_Read(dump_offset);
+        if (value != 0xFF) {
+            payload[n++] = value;
+            dump_crc = CRC16_Update(dump_crc, value);
+            dump_offset++;
+            continue;
         }
-        
-        case 0x70: { // Guardar Regla de Flujo
-            // Payload: 1(rule_idx) + 1(sec_idx) + 1(orig_mov) + 1(type) + 1(mask) + 1(dest_mov) = 6 bytes
-            if (len != 6) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            EEPROM_SaveFlowRule(buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7]);
-            UART_Send_ACK(cmd);
-            break;
+        uint8_t run = 0;
+        while (dump_offset < EEPROM_SIZE && run < 255 && EEPROM_Read(dump_offset) == 0xFF) {
+            dump_crc = CRC16_Update(dump_crc, 0xFF);
+            dump_offset++;
+            run++;
         }
+        payload[n++] = 0xFF;
+        payload[n++] = run;
+    }
 
-        case 0x71: { // Leer Regla de Flujo
-            if (len != 1) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            uint8_t rule_index = buffer[2];
-            uint8_t sec_idx, orig_mov, rule_type, mask, dest_mov;
-
-            EEPROM_ReadFlowRule(rule_index, &sec_idx, &orig_mov, &rule_type, &mask, &dest_mov);
-
-            if (sec_idx == 0xFF) {
-                UART_Send_NACK(cmd, ERROR_INVALID_DATA);
-            } else {
-                uint8_t payload[6];
-                payload[0] = rule_index;
-                payload[1] = sec_idx;
-                payload[2] = orig_mov;
-                payload[3] = rule_type;
-                payload[4] = mask;
-                payload[5] = dest_mov;
-                UART_Send_Frame(RESP_FLOW_RULE_DATA, payload, 6);
-            }
-            break;
-        }
-        
-        
-        case 0xF0: { // Restaurar a Fbrica
-            if (len != 0) { 
-                UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); 
-                break; 
-            }
+    uart1.tx_seq = dump_req_seq;
+    bool sent = UART_PortSendFrame(&uart1, RESP_DUMP_CHUNK, payload, n);
+    uart1.tx_seq = 0;
+    if (!sent) {
+        // Trozo no enviado: se rehace igual en la prxima pasada
+        dump_offset = start_offset;
+        dump_crc = start_crc;
+        return;
+    }
+    dump_seq++;
+}
 
-            // Paso 1: Confirmar INMEDIATAMENTE que se recibi la orden.
-            UART_Send_ACK(cmd);
-            
-            // Paso 2: Ahora s, realizar las operaciones largas.
-            // La GUI ya recibi su confirmacin y no dar timeout.
-            EEPROM_EraseAll();
-            EEPROM_InitStructure();
-            Scheduler_ReloadCache();
-            
-            Sequence_Engine_EnterFallback();
-            
-            // --- FIN DE LA CORRECCIN ---
-            break;
+/**
+ * @brief Enva la trama de telemetra cuando vence el periodo (cada 100 ms).
+ * @details Cada campo de la instantnea es un byte; solo se envan los que
+ * difieren de la ltima trama aceptada por el anillo TX. Si una trama no cabe,
+ * la siguiente sale completa para no dejar al receptor con una base vieja.
+ */
+void UART_TelemetryTick(void) {
+    if (telemetry_period == 0) return;
+    if (!UART_PortSpontaneousAllowed(&uart1)) {
+        telemetry_keyframe_countdown = 0; // Al salir del modo bus se reanuda con una trama completa
+        return;
+    }
+    if (telemetry_keyframe_countdown > 0) telemetry_keyframe_countdown--;
+    if (--telemetry_countdown > 0) return;
+    telemetry_countdown = telemetry_period;
+
+    EngineTelemetry t;
+    Sequence_Engine_GetTelemetry(&t);
+    uint8_t now[TELEMETRY_FIELDS];
+    now[0] = t.step;
+    now[1] = (uint8_t)(t.countdown_s >> 8);
+    now[2] = (uint8_t)(t.countdown_s & 0xFF);
+    now[3] = (uint8_t)t.plan_id;
+    now[4] = t.demands;
+    now[5] = t.flags;
+
+    bool keyframe = (telemetry_keyframe_countdown == 0);
+    uint8_t payload[3 + TELEMETRY_FIELDS];
+    uint8_t mask = keyframe ? TELEMETRY_KEYFRAME : 0;
+    uint8_t n = 3;
+    for (uint8_t i = 0; i < TELEMETRY_FIELDS; i++) {
+        if (keyframe || now[i] != telemetry_last[i]) {
+            mask |= (uint8_t)(1 << i);
+            payload[n++] = now[i];
         }
-        
-        case 0x80: { // 0x80
-            if (len != 0) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            g_monitoring_active = true;
-            UART_Send_ACK(cmd);
-            break;
+    }
+    if (mask == 0) return; // Cruce sin cambios: no se gasta la lnea
+
+    payload[0] = EEPROM_ReadControllerID();
+    payload[1] = telemetry_seq;
+    payload[2] = mask;
+    if (!UART_PortSendFrame(&uart1, CMD_TELEMETRY_FRAME, payload, n)) {
+        telemetry_keyframe_countdown = 0;
+        return;
+    }
+    telemetry_seq++;
+    memcpy(telemetry_last, now, TELEMETRY_FIELDS);
+    if (keyframe) telemetry_keyframe_countdown = TELEMETRY_KEYFRAME_TICKS;
+}
+
+/**
+ * @brief Reserva una ranura de trabajo y enva RESP_JOB_ACCEPTED.
+ * @return NULL (con NACK ya enviado) si no hay ranuras libres.
+ */
+static UartJob *UART_JobAccept(UartPort *port, uint8_t cmd) {
+    for (uint8_t i = 0; i < UART_MAX_JOBS; i++) {
+        UartJob *job = &uart_jobs[i];
+        if (job->active) continue;
+        job->active = true;
+        job->id = uart_next_job_id++;
+        job->cmd = cmd;
+        job->write_ok = false;
+        job->silent = port->mute;
+        job->seq = port->tx_seq;
+        job->ticket = EEPROM_GetWriteTicket();
+        job->start_ms = Timers_GetMillis();
+
+        uint8_t payload[2];
+        payload[0] = cmd;
+        payload[1] = job->id;
+        UART_PortReplyRecord(port, cmd, RESP_JOB_ACCEPTED, job->id);
+        UART_PortSendFrame(port, RESP_JOB_ACCEPTED, payload, 2);
+        return job;
+    }
+    UART_PortNack(port, cmd, ERROR_EXECUTION_FAIL);
+    return NULL;
+}
+
+/**
+ * @brief Anota el resultado del guardado y la marca de su ltima escritura.
+ */
+static void UART_JobSubmit(UartJob *job, bool write_ok, uint8_t table, uint8_t index) {
+    job->write_ok = write_ok;
+    job->table = table;
+    job->index = index;
+    job->ticket = EEPROM_GetWriteTicket();
+}
+
+/**
+ * @brief Enva RESP_JOB_DONE de los trabajos cuyas escrituras ya terminaron.
+ * @details Si la relectura coincide con otra grabacin en curso, o la trama no
+ * cabe en el anillo TX, el trabajo sigue activo y se reintenta en la prxima
+ * pasada de UART_Task.
+ */
+static void UART_JobService(void) {
+    for (uint8_t i = 0; i < UART_MAX_JOBS; i++) {
+        UartJob *job = &uart_jobs[i];
+        if (!job->active || !EEPROM_IsWriteDone(job->ticket)) continue;
+        if (job->silent) {
+            job->active = false;
+            continue;
         }
 
-        case 0x81: { // 0x81
-            if (len != 0) { UART_Send_NACK(cmd, ERROR_INVALID_LENGTH); break; }
-            g_monitoring_active = false;
-            UART_Send_ACK(cmd);
-            break;
+        uint8_t status = JOB_STATUS_OK;
+        if (!job->write_ok) {
+            status = JOB_STATUS_WRITE_FAIL;
+        } else {
+            uint8_t verify = EEPROM_VerifyRecord(job->table, job->index);
+            if (verify == EEPROM_VERIFY_BUSY) continue; // Otra grabacin en curso: prxima pasada
+            if (verify == EEPROM_VERIFY_MISMATCH) status = JOB_STATUS_VERIFY_FAIL;
+        }
+        uint16_t elapsed = Timers_GetMillis() - job->start_ms;
+
+        uint8_t payload[5];
+        payload[0] = job->cmd;
+        payload[1] = job->id;
+        payload[2] = status;
+        payload[3] = (uint8_t)(elapsed >> 8);
+        payload[4] = (uint8_t)(elapsed & 0xFF);
+        uart1.tx_seq = job->seq;
+        bool sent = UART_PortSendFrame(&uart1, RESP_JOB_DONE, payload, 5);
+        uart1.tx_seq = 0;
+        if (sent) {
+            job->active = false;
         }
-        
-        default:
-            UART_Send_NACK(cmd, ERROR_UNKNOWN_CMD);
-            break;
     }
 }
 
-
-// implementacin de UART2_HandleCompleteFrame --- >>>
 /**
- * @brief Procesa una trama completa recibida por UART2 (MMU).
+ * @brief Enva a la MMU el estado de LATD..LATJ cuando cambia, o como latido.
+ * @details Compara los registros LAT en lugar de enganchar cada escritura,
+ * as cubre apply_light_outputs(), el fallback, el destello manual y el
+ * parpadeo sin tocarlos. Se llama en cada pasada del bucle principal, tambin
+ * con el destello manual activo, de modo que el retardo queda acotado por
+ * una pasada. Si la trama no cabe en el anillo se reintenta en la siguiente.
  */
-static void UART2_HandleCompleteFrame(uint8_t *buffer, uint8_t length) {
-    uint8_t cmd = buffer[0];
-    uint8_t len = buffer[1];
-    
-    // 1. Validar Checksum
-    uint8_t chk_calc = cmd + len;
-    for (uint8_t i = 0; i < len; i++) chk_calc += buffer[2 + i];
-    uint8_t chk_received = buffer[2 + len];
-
-    if (chk_calc != chk_received) {
-        // La trama est corrupta, la ignoramos.
-        return; 
-    }
-
-    // 2. Procesar Comandos de la MMU
-    switch(cmd) {
-        
-        case CMD_MMU_GET_CONFIG: // 0x01
-            if (len == 0) {
-                // El comando es correcto, preparamos la respuesta
-                uint8_t mask_v, mask_p;
-                EEPROM_ReadOutputMasks(&mask_v, &mask_p);
-                
-                uint8_t payload[2];
-                payload[0] = mask_v; // Mscara vehicular
-                payload[1] = mask_p; // Mscara peatonal
-                
-                // Responder por UART2
-                UART2_Send_Frame(RESP_MMU_CONFIG_DATA, payload, 2);
-            }
-            // (Si len != 0, ignoramos el comando malformado)
-            break;
-            
-        // ... Aqu se aadirn futuros comandos de la MMU ...
-            
-        default:
-            // Ignorar comandos desconocidos
-            break;
+void UART2_OutputService(void) {
+    uint8_t now[MMU_OUTPUT_PORTS];
+    now[0] = LATD;
+    now[1] = LATE;
+    now[2] = LATF;
+    now[3] = LATH;
+    now[4] = LATJ;
+
+    uint8_t reason = MMU_OUTPUT_CHANGE;
+    if (mmu_output_sent && memcmp(now, mmu_output_last, MMU_OUTPUT_PORTS) == 0) {
+        if ((uint16_t)(Timers_GetMillis() - mmu_output_last_ms) < MMU_HEARTBEAT_MS) return;
+        reason = MMU_OUTPUT_HEARTBEAT;
+    }
+
+    uint8_t payload[2 + MMU_OUTPUT_PORTS];
+    payload[0] = mmu_output_seq;
+    payload[1] = reason;
+    memcpy(&payload[2], now, MMU_OUTPUT_PORTS);
+    if (!UART_PortSendFrame(&uart2, CMD_MMU_OUTPUT_STATE, payload, sizeof(payload))) {
+        return;
     }
+    mmu_output_seq++;
+    memcpy(mmu_output_last, now, MMU_OUTPUT_PORTS);
+    mmu_output_sent = true;
+    mmu_output_last_ms = Timers_GetMillis();
 }
-// <<< --- FIN DE LA MODIFICACIN --- >>>
\ No newline at end of file
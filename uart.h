@@ -23,6 +23,49 @@
 #define CMD_MONITOR_ENABLE 0x80
 #define CMD_MONITOR_DISABLE 0x81
 #define CMD_MONITOR_STATUS_REPORT 0x82
+// En modo bus (0x2A) 0x80 responde NACK ERROR_INVALID_DATA y no salen informes 0x82.
+// Telemetra peridica codificada por diferencias:
+// 0x83 [periodo]: en dcimas de segundo, 1..10 (100 ms a 1 s); 0 la desactiva.
+// Trama 0x84: [ID controlador][secuencia][mscara][campos cambiados...]
+//   Campos, bit 0..5 de la mscara: paso, cuenta H, cuenta L, plan, demandas,
+//   banderas (TELEMETRY_FLAG_*). Solo viajan los que cambiaron desde la trama
+//   anterior; sin cambios no se enva nada. Con el bit 7 (TELEMETRY_KEYFRAME)
+//   van todos: se enva al activar, cada 10 s y tras perder una trama, as el
+//   receptor que ve un salto en la secuencia se resincroniza.
+//   En modo bus (0x2A) no hay telemetra: 0x83 con periodo distinto de 0
+//   responde NACK ERROR_INVALID_DATA y la ya activa se suspende.
+#define CMD_SET_TELEMETRY         0x83
+#define CMD_TELEMETRY_FRAME       0x84
+#define TELEMETRY_KEYFRAME        0x80
+
+// --- Trabajos en segundo plano ---
+// Guardar movimiento (0x23), guardar plan (0x40) y restaurar a fbrica (0xF0)
+// responden al instante con 0x85 [cmd][id de trabajo] y, cuando la EEPROM ha
+// grabado y reledo el registro, con 0x86 [cmd][id][estado][ms H][ms L].
+// Mientras tanto el anfitrin puede seguir enviando otros comandos. Sin
+// ranuras libres (UART_MAX_JOBS en curso) el comando recibe NACK
+// ERROR_EXECUTION_FAIL y no se ejecuta.
+// Tras 0xF0 las tablas se limpian en segundo plano (unos 4 s como mucho); hasta
+// entonces los guardados de tablas (0x1A, 0x1D, 0x23, 0x30, 0x40, 0x50, 0x60 y
+// 0x70) tambin responden NACK ERROR_EXECUTION_FAIL y deben reintentarse.
+#define RESP_JOB_ACCEPTED         0x85
+#define RESP_JOB_DONE             0x86
+#define JOB_STATUS_OK             0x00
+#define JOB_STATUS_WRITE_FAIL     0x01 // Guardado rechazado o flash no verificada
+#define JOB_STATUS_VERIFY_FAIL    0x02 // La relectura de la EEPROM no coincide
+
+// --- Eventos y diagnsticos ---
+// Trama 0x87 [cdigo][arg0][arg1]; el texto de cada cdigo est en la tabla
+// del anfitrin. Sustituye a los mensajes ASCII de depuracin.
+// En modo bus solo salen los eventos que responden a una peticin dirigida
+// (pruebas del RTC); los espontneos (arranque, EEPROM) se descartan.
+#define CMD_EVENT_REPORT          0x87
+#define EVT_BOOT                  0x01 // arg0 = ID del controlador
+#define EVT_EEPROM_FORMATTED      0x02 // EEPROM sin inicializar: se carg la estructura de fbrica
+#define EVT_CONFIG_CRC_INVALID    0x03 // CRC de la configuracin invlido: modo fallback
+#define EVT_RTC_TEST_SET_TIME     0x10 // 0x25: arg0 = 1 si RTC_SetTime tuvo xito
+#define EVT_RTC_TEST_RAM          0x11 // 0x26: arg0 = 1 si la prueba de RAM pas
+#define EVT_RTC_TEST_VISUAL       0x12 // 0x27: prueba visual finalizada
 
 // --- Definiciones para los Comandos de Respuesta de Datos ---
 // Se sigue la convencin de que una respuesta a un comando CMD es (CMD | 0x80)
@@ -31,9 +74,120 @@
 #define CMD_SAVE_OUTPUT_MASKS 0x12
 #define CMD_READ_OUTPUT_MASKS 0x13
 #define RESP_OUTPUT_MASKS_DATA 0x93 // Respuesta a 0x13
+// Comandos de Estadsticas de Escritura EEPROM
+#define CMD_READ_EEPROM_STATS  0x14
+#define CMD_RESET_EEPROM_STATS 0x15
+#define RESP_EEPROM_STATS_DATA 0x94 // Respuesta a 0x14
+// Comandos de Integridad de la Configuracin (CRC)
+#define CMD_READ_CONFIG_INTEGRITY 0x16
+#define CMD_RESEAL_CONFIG         0x17
+#define RESP_CONFIG_INTEGRITY     0x96 // Respuesta a 0x16
+// Comando de Estado de Ejecucin (log de la EEPROM)
+#define CMD_READ_RUNTIME_STATE    0x18
+#define RESP_RUNTIME_STATE        0x98 // Respuesta a 0x18
+// 0x19: [desbordes TX H][desbordes TX L][tramas RX descartadas H][L]
+//       [errores RX H][L] (tramas truncadas por silencio, sin ETX o con
+//       desborde del receptor)
+#define CMD_READ_COMM_STATS       0x19
+#define RESP_COMM_STATS           0x99 // Respuesta a 0x19
+
+// Cambio de velocidad de UART1:
+// 0x28 [cdigo]: 0=9600, 1=19200, 2=38400, 3=57600, 4=115200. NACK si el
+//   divisor con _XTAL_FREQ supera el 3 % de error. Tras el ACK se cambia.
+// 0x29: confirmacin enviada a la nueva velocidad. Sin ella en 3 s se vuelve
+//   a la velocidad anterior. La velocidad no se guarda: al reiniciar es 9600.
+#define CMD_SET_BAUD              0x28
+#define CMD_CONFIRM_BAUD          0x29
+#define UART_DEFAULT_BAUD         9600UL
+
+// Direccionamiento en bus RS-485 multipunto (UART1):
+// 0x2A [modo][grupo]: modo 0 = punto a punto (tramas sin direccin, por
+//   defecto), bit 0 = bus. En modo bus cada trama lleva tras el STX un byte de
+//   direccin que entra en el checksum: 43 53 4F ADDR CMD LEN payload CHK 03 FF.
+//   Los bits 1 (SEQ, ver 0x2B) y 2 (CRC-16, ver 0x2C) fijan el formato para
+//   todo el bus: cada nodo tiene que saltar las tramas de los dems contando
+//   bytes, as que en modo bus 0x2B y 0x2C responden NACK ERROR_INVALID_DATA.
+//   La ISR descarta sin almacenar las tramas que no van al ID del controlador,
+//   a su grupo (UART_ADDR_NONE = sin grupo) ni a difusin. Las tramas de
+//   difusin o grupo se ejecutan sin respuesta; las respuestas llevan el ID
+//   propio como direccin. El ACK de 0x2A sale todava con el modo anterior.
+#define CMD_SET_BUS_MODE          0x2A
+#define UART_BUS_MODE_POINT_TO_POINT 0x00
+#define UART_BUS_MODE_ADDRESSED   0x01
+#define UART_BUS_MODE_SEQ         0x02
+#define UART_BUS_MODE_CRC16       0x04
+#define UART_BUS_MODE_MASK        0x07
+#define UART_ADDR_BROADCAST       0x00
+#define UART_ADDR_NONE            0xFF
+// Con el bus activo, 0x10 rechaza los ID reservados (0x00 y 0xFF) con NACK
+// ERROR_INVALID_DATA; punto a punto se guardan como siempre. Si la EEPROM tiene
+// uno de ellos, el bus usa UART_ADDR_DEFAULT como direccin.
+#define UART_ADDR_DEFAULT         0x01
+
+// Ventana de comandos secuenciados (UART1):
+// 0x2B [0/1]: activa el modo secuenciado para la sesin (no se guarda). Cada
+//   trama lleva tras el STX (y la direccin, en modo bus) un byte SEQ que
+//   entra en el checksum: 43 53 4F [ADDR] SEQ CMD LEN payload CHK 03 FF.
+//   El anfitrin numera sus peticiones de 1 a 255 y puede tener varias en
+//   vuelo; cada respuesta (ACK, NACK, datos, RESP_JOB_DONE, volcado) repite
+//   el SEQ de su peticin y las tramas espontneas llevan SEQ 0. Si una
+//   respuesta no llega, se retransmite solo esa peticin con el mismo SEQ:
+//   las ya respondidas con ACK/NACK no se vuelven a ejecutar, salvo un NACK
+//   ERROR_EXECUTION_FAIL (fallo pasajero), que se reintenta. Un trabajo ya
+//   aceptado tampoco se relanza: se repite su 0x85 con el mismo id, y su 0x86
+//   sale una sola vez. Solo se repite la respuesta de una peticin idntica
+//   (mismo CMD, LEN y payload) entre las 8 ltimas SEQ; el anfitrin no debe
+//   tener ms en vuelo. El ACK de 0x2B sale todava con el formato anterior.
+#define CMD_SET_SEQ_MODE          0x2B
+
+// Verificacin de trama (UART1 y UART2):
+// 0x2C [0/1]: 0 = suma de 8 bits (por defecto), 1 = CRC-16/CCITT (0x1021,
+//   inicial 0xFFFF) de 2 bytes, alto primero, en lugar del byte CHK:
+//   43 53 4F [ADDR] [SEQ] CMD LEN payload CRC_H CRC_L 03 FF. Cubre los mismos
+//   bytes que la suma y detecta bytes permutados y errores de varios bits.
+//   Solo para la sesin (no se guarda); el ACK sale con la verificacin
+//   anterior. Tras pasar a CRC, si en 3 s no llega ninguna trama vlida con
+//   CRC (el ACK se perdi), el puerto vuelve solo a la suma. En UART2 los
+//   errores se siguen ignorando sin NACK.
+#define CMD_SET_FRAME_CHECK       0x2C
+#define UART_FRAME_CHECK_SUM      0x00
+#define UART_FRAME_CHECK_CRC16    0x01
+
+// Comandos de Carga Masiva de Tablas
+// 0x1A: [tabla (EEPROM_Table)][ndice inicial][cantidad][registros...]
+// Registros con el mismo formato que los comandos individuales, sin el ndice.
+// Si falla la escritura de un registro responde NACK [0x1A][ERROR_EXECUTION_FAIL]
+// [ndice]; los registros anteriores del bloque ya quedaron guardados.
+// 0x1B: fin de la carga; recarga cachs del scheduler y del motor una sola vez.
+#define CMD_BULK_WRITE            0x1A
+#define CMD_BULK_COMMIT           0x1B
+// Volcado de la imagen EEPROM completa (1 KB) en tramas secuenciadas.
+// Trozo 0x9C: [secuencia][dir H][dir L][datos RLE...]
+//   RLE: cualquier 0xFF se codifica como [0xFF][n], con n = bytes 0xFF seguidos (1..255).
+// Final 0x9D: [trozos enviados][tamao H][tamao L][CRC16 H][CRC16 L] sobre la imagen sin comprimir.
+// En modo bus solo se atiende dirigido al ID propio; en difusin o grupo se ignora.
+#define CMD_DUMP_IMAGE            0x1C
+#define RESP_DUMP_CHUNK           0x9C
+#define RESP_DUMP_END             0x9D
+// Transaccin de configuracin: 0x1D abre, los comandos de guardado normales
+// (o 0x1A) cargan la configuracin, 0x1E valida y activa en el prximo lmite
+// de ciclo (NACK ERROR_INVALID_DATA si hay referencias rotas), 0x1F aborta:
+// la configuracin anterior se restaura en segundo plano y sigue en marcha.
+// 0x1D responde NACK ERROR_EXECUTION_FAIL si ya hay una transaccin abierta
+// o en restauracin.
+#define CMD_CONFIG_BEGIN          0x1D
+#define CMD_CONFIG_COMMIT         0x1E
+#define CMD_CONFIG_ABORT          0x1F
 // Comandos de Protocolo MMU (UART2) 
 #define CMD_MMU_GET_CONFIG 0x01       // Comando: MMU solicita configuracin
 #define RESP_MMU_CONFIG_DATA 0x81     // Respuesta: CPU enva datos de configuracin
+// 0x02 (CPU -> MMU, espontnea): [seq][motivo][LATD][LATE][LATF][LATH][LATJ]
+//   Salidas que la CPU est mandando. Sale en la misma pasada del bucle en que
+//   cambia cualquier LAT y, sin cambios, como latido cada 250 ms. seq avanza
+//   en cada trama para que la MMU detecte prdidas.
+#define CMD_MMU_OUTPUT_STATE 0x02
+#define MMU_OUTPUT_CHANGE    0x00
+#define MMU_OUTPUT_HEARTBEAT 0x01
 // FIN Comandos de Protocolo MMU (UART2) 
 #define RESP_RTC_TIME      0xA1 // Respuesta a 0x21
 #define RESP_MOVEMENT_DATA 0xA4 // Respuesta a 0x24
@@ -50,8 +204,24 @@ void UART_Send_NACK(uint8_t original_cmd, uint8_t error_code);
 // --- Funciones Pblicas Estndar ---
 void UART1_Init(uint32_t baudrate);
 void UART2_Init(uint32_t baudrate);
-void UART1_SendString(const char *str); // Ahora es no bloqueante
+void UART_Send_Event(uint8_t code, uint8_t arg0, uint8_t arg1); // No bloqueante
 void UART_Task(void);                   // Tarea de procesamiento para el bucle principal
+void UART_BaudTick(void);               // Plazo de confirmacin de velocidad (cada segundo)
+void UART_FrameCheckTick(void);         // Plazo de confirmacin del modo CRC (cada segundo)
+void UART_TelemetryTick(void);          // Telemetra peridica (cada 100 ms)
+void UART2_OutputService(void);         // Estado de salidas a la MMU (cada pasada)
+/**
+ * @brief Mensajes de UART1 descartados porque no caban en el anillo TX.
+ */
+uint16_t UART_GetTxOverflowCount(void);
+/**
+ * @brief Tramas de UART1 descartadas porque la cola de recepcin estaba llena.
+ */
+uint16_t UART_GetRxDroppedCount(void);
+/**
+ * @brief Tramas de UART1 perdidas por ruido: truncadas, sin ETX o con desborde.
+ */
+uint16_t UART_GetRxErrorCount(void);
 void UART_Send_Monitoring_Report(uint8_t portD, uint8_t portE, uint8_t portF, uint8_t portH, uint8_t portJ);
 // =============================================================================
 // --- PROTOTIPOS PARA LA ISR (LA CORRECCIN EST AQU) ---
@@ -70,6 +240,18 @@ void UART_ProcessReceivedByte(uint8_t byte);
  */
 void UART_Transmit_ISR(void);
 
+/**
+ * @brief Vigila el silencio entre bytes de UART1 y UART2. Llamada cada 1 ms
+ * desde la ISR del Timer1; una trama a medias se descarta a los 20 ms.
+ */
+void UART_RxTimer_ISR(void);
+
+/**
+ * @brief Descarta la trama en curso tras un desborde (OERR) del receptor.
+ */
+void UART_RxOverrun_ISR(void);
+void UART2_RxOverrun_ISR(void);
+
 /**
  * @brief Procesa un byte recin llegado por la UART2. Llamada desde la ISR de RX.
  * @param byte El byte ledo del registro RCREG2.